@@ -47,6 +47,29 @@ int amp_write_symbol(char **pos, char *limit, size_t size, char *symbol);
 int amp_write_start(char **pos, char *limit, char **start);
 int amp_write_list(char **pos, char *limit, char *start, size_t count);
 int amp_write_map(char **pos, char *limit, char *start, size_t count);
+int amp_write_raw(char **pos, char *limit, size_t size, char *bytes);
+
+/* The readers mirror the writers, they return 0 having read a value,
+   1 for a null, which leaves the value alone, or -1 if the bytes run
+   out or hold something else. The unsigned readers take any unsigned
+   encoding the value fits. Variable width values are left where they
+   are in the bytes and the raw reader does the same for a whole datum,
+   whatever it is. The descriptor reader returns 0 for a numeric
+   descriptor, setting code, and 1 for a symbolic one, setting size and
+   symbol instead. */
+int amp_read_descriptor(char **pos, char *limit, uint64_t *code, size_t *size,
+                        char **symbol);
+int amp_read_boolean(char **pos, char *limit, bool *v);
+int amp_read_ubyte(char **pos, char *limit, uint8_t *v);
+int amp_read_ushort(char **pos, char *limit, uint16_t *v);
+int amp_read_uint(char **pos, char *limit, uint32_t *v);
+int amp_read_ulong(char **pos, char *limit, uint64_t *v);
+int amp_read_binary(char **pos, char *limit, size_t *size, char **bytes);
+int amp_read_utf8(char **pos, char *limit, size_t *size, char **utf8);
+int amp_read_symbol(char **pos, char *limit, size_t *size, char **symbol);
+int amp_read_raw(char **pos, char *limit, size_t *size, char **bytes);
+/* reads the head of a list, end is where its last item stops */
+int amp_read_list(char **pos, char *limit, size_t *count, char **end);
 
 typedef struct {
   void (*on_null)(void *ctx);
@@ -23,27 +23,167 @@
  */
 
 #include <amp/engine.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef struct amp_driver_t amp_driver_t;
 typedef struct amp_selectable_st amp_selectable_t;
+typedef struct amp_pool_t amp_pool_t;
+typedef struct amp_loopback_t amp_loopback_t;
 
 #define AMP_SEL_RD (0x0001)
 #define AMP_SEL_WR (0x0002)
+/* The peer hanging up is reported as readable even without AMP_SEL_RD,
+   so a connection that has stopped reading still notices a dead peer. */
+#define AMP_SEL_HUP (0x0004)
 
+/* Counters cheap enough to leave on. Times are in nanoseconds, handler
+   time covers ticks, I/O handlers and posted commands. */
+typedef struct amp_driver_stats_t {
+  uint64_t iterations;//passes through the loop
+  uint64_t wait_ns;//blocked waiting for something to happen
+  uint64_t handler_ns;
+  uint64_t handler_max_ns;//the slowest single handler call
+  uint64_t commands;//posted commands run
+  uint64_t spins;//busy polls that found nothing to do
+  uint64_t hits;//busy polls that did
+  uint64_t drained;//connections that flushed everything while draining
+  uint64_t abandoned;//and those that were cut off before they could
+} amp_driver_stats_t;
+
+typedef struct amp_selectable_stats_t {
+  uint64_t readable;//readiness events handled
+  uint64_t writable;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t recv_calls;//syscalls, none when the io_uring does the I/O
+  uint64_t send_calls;
+  uint64_t eagain;//reads and writes that would have blocked
+  size_t input_high;//most unconsumed input held at once
+  size_t output_high;//most output pending at once
+} amp_selectable_stats_t;
+
+typedef enum amp_backend_t {AMP_POLL=1, AMP_EPOLL=2, AMP_URING=3} amp_backend_t;
+
+/* Milliseconds on a monotonic clock, this is the time base the driver
+   passes to amp_tick. */
+time_t amp_now(void);
+
+/* amp_driver takes its backend from $AMP_DRIVER (poll, epoll or uring)
+   and defaults to epoll. A backend the platform lacks falls back to
+   epoll and then poll, amp_driver_get_backend reports the one in use. */
 amp_driver_t *amp_driver(void);
+amp_driver_t *amp_driver_backend(amp_backend_t backend);
+amp_backend_t amp_driver_get_backend(amp_driver_t *d);
 void amp_driver_run(amp_driver_t *d);
 void amp_driver_stop(amp_driver_t *d);
+/* Shuts the driver down gracefully: acceptors are closed, every
+   connection is sent a CLOSE, and each one is let go once its output
+   has all been written and the peer has answered or hung up. The loop
+   returns when none are left, those still around after timeout
+   milliseconds are cut off. How it went is in the drained and
+   abandoned counters of amp_driver_stats. Safe to call from any
+   thread. */
+int amp_driver_drain(amp_driver_t *d, int timeout);
 void amp_driver_destroy(amp_driver_t *d);
+/* Listen backlog for acceptors created afterwards, SOMAXCONN by
+   default. */
+void amp_driver_set_backlog(amp_driver_t *d, int backlog);
+/* Accepted peers are only ever reported by address. With resolve set,
+   their names are also looked up, off the loop thread. */
+void amp_driver_set_resolve(amp_driver_t *d, bool resolve);
+/* A connection holding more than high bytes (see amp_buffered) stops
+   reading from its socket until it gets back down to low. Defaults to
+   4MB and 1MB, a high of 0 turns it off. A paused connection is only
+   looked at again as the peer hangs up, as its output goes out and as
+   it is ticked, so deliveries taken off it outside of its callback
+   need an amp_selectable_wakeup to get it reading again. */
+void amp_driver_set_watermarks(amp_driver_t *d, size_t high, size_t low);
+/* With coalescing on, connections do not write as they are ticked but
+   once all ticks of a pass are done, so everything a connection has
+   to say in a pass goes out in a single write. */
+void amp_driver_set_coalesce(amp_driver_t *d, bool coalesce);
+/* Busy polling: with nothing to do the loop keeps checking for
+   readiness without blocking for up to spin_us microseconds before it
+   goes to sleep, trading a core for wakeup latency. amp_driver also
+   takes spin_us from $AMP_SPIN. A non zero busy_poll_us additionally
+   sets SO_BUSY_POLL on sockets the driver opens from then on. The spins
+   and hits of amp_driver_stats tell spins that came back empty from
+   ones that found work. */
+void amp_driver_set_busy_poll(amp_driver_t *d, unsigned spin_us, unsigned busy_poll_us);
+/* Idle timeout in milliseconds for connections created afterwards, see
+   amp_set_idle_timeout, 0 (the default) for none. */
+void amp_driver_set_idle_timeout(amp_driver_t *d, uint32_t timeout);
+/* Connections created afterwards trace to the ring, at the level from
+   $AMP_TRACE or else at AMP_TRACE_FRAMES. The ring has to outlive
+   them. */
+void amp_driver_set_trace(amp_driver_t *d, amp_trace_ring_t *ring);
+/* Safe to call from any thread. */
+amp_driver_stats_t amp_driver_stats(amp_driver_t *d);
+
+/* Queues run(d, arg) to be called on the driver's loop thread on its
+   next wakeup. This is the only driver call that is safe to make from
+   other threads besides amp_driver_stop and amp_driver_drain. Commands
+   still queued when the driver is destroyed are dropped. */
+int amp_driver_post(amp_driver_t *d, void (*run)(amp_driver_t *d, void *arg), void *arg);
+
+/* A pool runs one driver per thread. Acceptors created on the pool's
+   drivers listen with SO_REUSEPORT, and every connection stays on the
+   driver (and so the thread) that accepted it. A size of 0 means one
+   driver per online cpu. */
+amp_pool_t *amp_pool(size_t size);
+size_t amp_pool_size(amp_pool_t *p);
+amp_driver_t *amp_pool_driver(amp_pool_t *p, size_t index);
+void amp_pool_run(amp_pool_t *p);
+void amp_pool_stop(amp_pool_t *p);
+void amp_pool_drain(amp_pool_t *p, int timeout);
+void amp_pool_destroy(amp_pool_t *p);
 
 amp_selectable_t *amp_acceptor(amp_driver_t *driver, char *host, char *port,
                                void (*cb)(amp_connection_t*, void*),
                                void* context);
+/* Returns before the connection is established. The host is looked up
+   off the loop thread, or taken from the driver's cache of recent
+   lookups, and every address it resolves to is tried in turn. Returns
+   NULL when the connection has failed already, as when every address
+   is refused straight away. */
 amp_selectable_t *amp_connector(amp_driver_t *driver, char *host, char *port,
                                 void (*cb)(amp_connection_t*, void*),
                                 void* context);
+/* Same, but for addresses the caller has already resolved. */
+struct addrinfo;
+amp_selectable_t *amp_connector_addrinfo(amp_driver_t *driver, const struct addrinfo *addrs,
+                                         void (*cb)(amp_connection_t*, void*),
+                                         void* context);
+/* Unix domain socket variants, a path starting with '@' names a socket
+   in the Linux abstract namespace. A filesystem path must not exist yet
+   when the acceptor binds to it. */
+amp_selectable_t *amp_unix_acceptor(amp_driver_t *driver, char *path,
+                                    void (*cb)(amp_connection_t*, void*),
+                                    void* context);
+amp_selectable_t *amp_unix_connector(amp_driver_t *driver, char *path,
+                                     void (*cb)(amp_connection_t*, void*),
+                                     void* context);
 
 void amp_selectable_destroy(amp_selectable_t *sel);
+/* Asks the driver to tick the selectable on its next pass, e.g. from a
+   posted command that has just given its connection more work. Only
+   call this from the loop thread. */
+void amp_selectable_wakeup(amp_selectable_t *sel);
+/* Only call this from the loop thread. */
+amp_selectable_stats_t amp_selectable_stats(amp_selectable_t *sel);
+
+/* Two connections wired back to back in memory, for exercising the
+   engine without sockets or threads. Each pump runs both callbacks and
+   then moves whatever either transport has to say into the other one,
+   returning the number of bytes moved. amp_loopback_run pumps until a
+   pass moves nothing and returns the number of passes that did. */
+amp_loopback_t *amp_loopback(void (*client)(amp_connection_t*, void*), void *client_context,
+                             void (*server)(amp_connection_t*, void*), void *server_context);
+size_t amp_loopback_pump(amp_loopback_t *l);
+size_t amp_loopback_run(amp_loopback_t *l);
+size_t amp_loopback_frames(amp_loopback_t *l);
+void amp_loopback_destroy(amp_loopback_t *l);
 
 
 #endif /* driver.h */
@@ -24,7 +24,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <amp/value.h>
 
 typedef struct amp_error_t amp_error_t;
@@ -36,10 +38,12 @@ typedef struct amp_link_t amp_link_t;
 typedef struct amp_sender_t amp_sender_t;
 typedef struct amp_receiver_t amp_receiver_t;
 typedef struct amp_delivery_t amp_delivery_t;
+typedef struct amp_trace_ring_t amp_trace_ring_t;
 
 typedef enum amp_endpoint_state_t {UNINIT=1, ACTIVE=2, CLOSED=4} amp_endpoint_state_t;
 typedef enum amp_endpoint_type_t {CONNECTION=1, TRANSPORT=2, SESSION=3, SENDER=4, RECEIVER=5} amp_endpoint_type_t;
 typedef enum amp_disposition_t {RECEIVED=1, ACCEPTED=2, REJECTED=3, RELEASED=4, MODIFIED=5} amp_disposition_t;
+typedef enum amp_trace_level_t {AMP_TRACE_OFF=0, AMP_TRACE_FRAMES=1, AMP_TRACE_PAYLOAD=2} amp_trace_level_t;
 
 /* Currently the way inheritence is done it is safe to "upcast" from
    amp_{transport,connection,session,link,sender,or receiver}_t to
@@ -58,6 +62,11 @@ void amp_close(amp_endpoint_t *endpoint);
 
 // connection
 amp_connection_t *amp_connection();
+/* A connection turns dirty when frames arrive for it or when local
+   calls give it work, so there is only reason to look at it again
+   while it is. */
+bool amp_connection_dirty(amp_connection_t *connection);
+void amp_connection_clean(amp_connection_t *connection);
 amp_delivery_t *amp_work_head(amp_connection_t *connection);
 amp_delivery_t *amp_work_next(amp_delivery_t *delivery);
 
@@ -75,8 +84,65 @@ amp_endpoint_t *amp_endpoint_next(amp_endpoint_t *endpoint,
 // transport
 #define EOS (-1)
 ssize_t amp_input(amp_transport_t *transport, char *bytes, size_t available);
+/* the largest frame we are prepared to receive, advertised in our OPEN
+   so it can only be changed before that is sent */
+void amp_set_max_frame(amp_transport_t *transport, uint32_t size);
+uint32_t amp_get_max_frame(amp_transport_t *transport);
+/* what the peer advertised in its OPEN, 0 until that arrives */
+uint32_t amp_get_remote_max_frame(amp_transport_t *transport);
+/* The peer is given up on once nothing has been heard from it for this
+   many milliseconds, 0 (the default) waits forever. Like the max frame
+   size it goes out in our OPEN. Empty frames are sent by amp_tick to
+   keep the peer from giving up on us in turn. */
+void amp_set_idle_timeout(amp_transport_t *transport, uint32_t timeout);
+uint32_t amp_get_idle_timeout(amp_transport_t *transport);
+uint32_t amp_get_remote_idle_timeout(amp_transport_t *transport);
+/* bytes the transport is holding on to: payload of incoming deliveries
+   not yet taken with amp_recv and output not yet written out */
+size_t amp_buffered(amp_transport_t *transport);
 ssize_t amp_output(amp_transport_t *transport, char *bytes, size_t size);
+/* Points up to iovcnt iovecs at the transport's pending output without
+   copying it and returns how many were filled in, or EOS. The output
+   can take two iovecs, as it wraps around. The bytes stay pending,
+   and the iovecs valid, until released with amp_output_consume, even
+   as more output is queued behind them. */
+int amp_output_iov(amp_transport_t *transport, struct iovec *iov, int iovcnt);
+void amp_output_consume(amp_transport_t *transport, size_t n);
+/* now is in milliseconds on a monotonic clock, the result is the next
+   deadline on that same clock at which amp_tick wants to be called
+   again, or 0 if there is none */
 time_t amp_tick(amp_transport_t *engine, time_t now);
+union amp_performative;
+/* Called for each performative received, performative holding its
+   fields as read into the struct generated for it and payload whatever
+   followed it in the frame. Both point into the input, so they only
+   last for the call. */
+typedef void (*amp_handler_t)(amp_transport_t *transport, uint16_t channel,
+                              union amp_performative *performative,
+                              const char *payload, size_t size);
+/* Hooks handler in for the performative with the given descriptor code
+   and returns the one it replaces, which it may pass calls on to, or
+   NULL if the code is not that of a performative. */
+amp_handler_t amp_set_handler(amp_transport_t *transport, uint64_t code,
+                              amp_handler_t handler);
+
+/* Frames are traced to stderr, or recorded in a ring when the
+   transport has one. AMP_TRACE_FRAMES leaves out message payload. New
+   transports take their level from $AMP_TRACE (off, frames or payload),
+   off when it is unset, and with tracing off nothing is formatted or
+   copied at all. */
+void amp_trace_set(amp_transport_t *transport, amp_trace_level_t level);
+amp_trace_level_t amp_trace_get(amp_transport_t *transport);
+void amp_trace_sink(amp_transport_t *transport, amp_trace_ring_t *ring);
+/* A ring keeps the last count frames (rounded up to a power of two)
+   as they went over the wire, at most snap bytes of each, along with
+   when they did. Any number of transports on any number of threads may
+   share one, recording takes no locks. */
+amp_trace_ring_t *amp_trace_ring(size_t count, size_t snap);
+void amp_trace_ring_free(amp_trace_ring_t *ring);
+/* Writes out what the ring holds, oldest first. Frames being recorded
+   while it runs are skipped. */
+void amp_trace_dump(amp_trace_ring_t *ring, FILE *out);
 
 // session
 amp_sender_t *amp_sender(amp_session_t *session, const wchar_t *name);
@@ -38,5 +38,9 @@ typedef struct {
 
 size_t amp_read_frame(amp_frame_t *frame, char *bytes, size_t available);
 size_t amp_write_frame(char *bytes, size_t size, amp_frame_t frame);
+/* For frames encoded in place: fills in the header of a size byte frame
+   at bytes whose body already follows the header. There is no extended
+   header. */
+void amp_write_frame_header(char *bytes, size_t size, uint8_t type, uint16_t channel);
 
 #endif /* framing.h */
@@ -161,6 +161,7 @@ void amp_visit_tag(amp_tag_t *t, void (*visitor)(amp_value_t));
 #define amp_to_uint8(V) ((V).u.as_ubyte)
 #define amp_to_uint16(V) ((V).u.as_ushort)
 #define amp_to_uint32(V) ((V).u.as_uint)
+#define amp_to_uint64(V) ((V).u.as_ulong)
 #define amp_to_int32(V) ((V).u.as_int)
 #define amp_to_bool(V) ((V).u.as_boolean)
 #define amp_to_string(V) ((V).u.as_string)
@@ -170,6 +171,7 @@ void amp_visit_tag(amp_tag_t *t, void (*visitor)(amp_value_t));
 /* string */
 
 amp_string_t *amp_string(wchar_t *wcs);
+amp_string_t *amp_string_utf8(char *utf8, size_t size);
 size_t amp_string_size(amp_string_t *str);
 wchar_t *amp_string_wcs(amp_string_t *str);
 
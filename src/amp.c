@@ -22,6 +22,7 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <amp/driver.h>
 #include <amp/value.h>
@@ -280,7 +281,7 @@ void client_callback(amp_connection_t *connection, void *context)
   {
     switch (amp_endpoint_type(endpoint)) {
     case CONNECTION:
-      amp_driver_stop(ctx->driver);
+      if (ctx->driver) amp_driver_stop(ctx->driver);
       break;
     case SESSION:
     case SENDER:
@@ -299,13 +300,51 @@ int main(int argc, char **argv)
     return value(argc, argv);
   }
 
+  if (argc > 1 && !strcmp(argv[1], "loopback"))
+  {
+    int rounds = argc > 2 ? atoi(argv[2]) : 1;
+    size_t frames = 0;
+    time_t start = amp_now();
+    for (int i = 0; i < rounds; i++) {
+      struct client_context cctx = {false, 10, 10, NULL};
+      struct server_context sctx = {0};
+      amp_loopback_t *l = amp_loopback(client_callback, &cctx, server_callback, &sctx);
+      amp_loopback_run(l);
+      frames += amp_loopback_frames(l);
+      amp_loopback_destroy(l);
+    }
+    time_t elapsed = amp_now() - start;
+    printf("%zu frames in %ld ms (%.0f frames/sec)\n", frames, (long) elapsed,
+           elapsed ? frames*1000.0/elapsed : 0.0);
+    return 0;
+  }
+
+  if (argc > 2 && !strcmp(argv[1], "server"))
+  {
+    amp_pool_t *pool = amp_pool(atoi(argv[2]));
+    size_t n = amp_pool_size(pool);
+    struct server_context ctxs[n];
+    for (int i = 0; i < n; i++) {
+      ctxs[i].count = 0;
+      if (!amp_acceptor(amp_pool_driver(pool, i), "0.0.0.0", "5672", server_callback, &ctxs[i]))
+        perror("amp");
+    }
+    amp_pool_run(pool);
+    amp_pool_destroy(pool);
+    return 0;
+  }
+
   amp_driver_t *drv = amp_driver();
-  if (argc > 1) {
-    struct client_context ctx = {false, 10, 10, drv};
-    if (!amp_connector(drv, "0.0.0.0", "5672", client_callback, &ctx)) perror("amp");
+  struct client_context cctx = {false, 10, 10, drv};
+  struct server_context sctx = {0};
+  if (argc > 2 && !strcmp(argv[1], "unix-server")) {
+    if (!amp_unix_acceptor(drv, argv[2], server_callback, &sctx)) perror("amp");
+  } else if (argc > 2 && !strcmp(argv[1], "unix-client")) {
+    if (!amp_unix_connector(drv, argv[2], client_callback, &cctx)) perror("amp");
+  } else if (argc > 1) {
+    if (!amp_connector(drv, "0.0.0.0", "5672", client_callback, &cctx)) perror("amp");
   } else {
-    struct server_context ctx = {0};
-    if (!amp_acceptor(drv, "0.0.0.0", "5672", server_callback, &ctx)) perror("amp");
+    if (!amp_acceptor(drv, "0.0.0.0", "5672", server_callback, &sctx)) perror("amp");
   }
 
   amp_driver_run(drv);
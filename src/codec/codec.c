@@ -205,8 +205,204 @@ int amp_write_map(char **pos, char *limit, char *start, size_t count) {
   return amp_write_end(pos, limit, start, 2*count, AMPE_MAP32);
 }
 
+int amp_write_raw(char **pos, char *limit, size_t size, char *bytes) {
+  if (limit - *pos < size) return -1;
+  memmove(*pos, bytes, size);
+  *pos += size;
+  return 0;
+}
+
 ssize_t amp_read_datum(char *bytes, size_t n, amp_data_callbacks_t *cb, void *ctx);
 
+static int amp_read_null(char **pos, char *limit) {
+  if (limit - *pos < 1) return -1;
+  if (**pos != AMPE_NULL) return 0;
+  *pos += 1;
+  return 1;
+}
+
+static int amp_read_unsigned(char **pos, char *limit, uint64_t *v) {
+  char *src = *pos;
+  size_t width;
+  int n;
+  if ((n = amp_read_null(pos, limit))) return n;
+
+  switch ((uint8_t) src[0])
+  {
+  case AMPE_UINT0:
+  case AMPE_ULONG0:
+    width = 0;
+    *v = 0;
+    break;
+  case AMPE_UBYTE:
+  case AMPE_SMALLUINT:
+  case AMPE_SMALLULONG:
+    width = 1;
+    if (limit - src < 2) return -1;
+    *v = *((uint8_t *) (src + 1));
+    break;
+  case AMPE_USHORT:
+    width = 2;
+    if (limit - src < 3) return -1;
+    *v = ntohs(*((uint16_t *) (src + 1)));
+    break;
+  case AMPE_UINT:
+    width = 4;
+    if (limit - src < 5) return -1;
+    *v = ntohl(*((uint32_t *) (src + 1)));
+    break;
+  case AMPE_ULONG:
+    width = 8;
+    if (limit - src < 9) return -1;
+    *v = ((uint64_t) ntohl(*((uint32_t *) (src + 1)))) << 32 |
+      ntohl(*((uint32_t *) (src + 5)));
+    break;
+  default:
+    return -1;
+  }
+
+  *pos += 1 + width;
+  return 0;
+}
+
+int amp_read_descriptor(char **pos, char *limit, uint64_t *code, size_t *size,
+                        char **symbol) {
+  char *src = *pos;
+  if (limit - src < 1 || src[0] != AMPE_DESCRIPTOR) return -1;
+  *pos += 1;
+  int e = amp_read_symbol(pos, limit, size, symbol);
+  if (!e) return 1;
+  if (e > 0 || amp_read_unsigned(pos, limit, code)) {
+    *pos = src;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_read_boolean(char **pos, char *limit, bool *v) {
+  char *src = *pos;
+  int n;
+  if ((n = amp_read_null(pos, limit))) return n;
+
+  switch ((uint8_t) src[0])
+  {
+  case AMPE_TRUE:
+  case AMPE_FALSE:
+    *v = src[0] == AMPE_TRUE;
+    *pos += 1;
+    return 0;
+  case AMPE_BOOLEAN:
+    if (limit - src < 2) return -1;
+    *v = src[1] != 0;
+    *pos += 2;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+#define AMP_READ_UNSIGNED(NAME, TYPE, MAX)                        \
+  int amp_read_ ## NAME(char **pos, char *limit, TYPE *v) {       \
+    char *src = *pos;                                             \
+    uint64_t u;                                                   \
+    int n = amp_read_unsigned(pos, limit, &u);                    \
+    if (n) return n;                                              \
+    if (u > MAX) {                                                \
+      *pos = src;                                                 \
+      return -1;                                                  \
+    }                                                             \
+    *v = u;                                                       \
+    return 0;                                                     \
+  }
+
+AMP_READ_UNSIGNED(ubyte, uint8_t, UINT8_MAX)
+AMP_READ_UNSIGNED(ushort, uint16_t, UINT16_MAX)
+AMP_READ_UNSIGNED(uint, uint32_t, UINT32_MAX)
+AMP_READ_UNSIGNED(ulong, uint64_t, UINT64_MAX)
+
+static int amp_read_variable(char **pos, char *limit, size_t *size, char **bytes,
+                             uint8_t code8, uint8_t code32) {
+  char *src = *pos;
+  size_t width;
+  size_t n;
+  int e;
+  if ((e = amp_read_null(pos, limit))) return e;
+
+  if ((uint8_t) src[0] == code8) {
+    width = 1;
+    if (limit - src < 2) return -1;
+    n = *((uint8_t *) (src + 1));
+  } else if ((uint8_t) src[0] == code32) {
+    width = 4;
+    if (limit - src < 5) return -1;
+    n = ntohl(*((uint32_t *) (src + 1)));
+  } else {
+    return -1;
+  }
+
+  if (limit - src - 1 - width < n) return -1;
+  *size = n;
+  *bytes = src + 1 + width;
+  *pos = *bytes + n;
+  return 0;
+}
+int amp_read_binary(char **pos, char *limit, size_t *size, char **bytes) {
+  return amp_read_variable(pos, limit, size, bytes, AMPE_VBIN8, AMPE_VBIN32);
+}
+int amp_read_utf8(char **pos, char *limit, size_t *size, char **utf8) {
+  return amp_read_variable(pos, limit, size, utf8, AMPE_STR8_UTF8, AMPE_STR32_UTF8);
+}
+int amp_read_symbol(char **pos, char *limit, size_t *size, char **symbol) {
+  return amp_read_variable(pos, limit, size, symbol, AMPE_SYM8, AMPE_SYM32);
+}
+
+int amp_read_raw(char **pos, char *limit, size_t *size, char **bytes) {
+  int e;
+  if ((e = amp_read_null(pos, limit))) return e;
+  ssize_t n = amp_read_datum(*pos, limit - *pos, noop, NULL);
+  if (n < 0 || n > limit - *pos) return -1;
+  *size = n;
+  *bytes = *pos;
+  *pos += n;
+  return 0;
+}
+
+int amp_read_list(char **pos, char *limit, size_t *count, char **end) {
+  char *src = *pos;
+  size_t width;
+  size_t size;
+  if (limit - src < 1) return -1;
+
+  switch ((uint8_t) src[0])
+  {
+  case AMPE_LIST0:
+    *count = 0;
+    *pos += 1;
+    *end = *pos;
+    return 0;
+  case AMPE_LIST8:
+    width = 1;
+    if (limit - src < 3) return -1;
+    size = *((uint8_t *) (src + 1));
+    *count = *((uint8_t *) (src + 2));
+    break;
+  case AMPE_LIST32:
+    width = 4;
+    if (limit - src < 9) return -1;
+    size = ntohl(*((uint32_t *) (src + 1)));
+    *count = ntohl(*((uint32_t *) (src + 5)));
+    break;
+  default:
+    return -1;
+  }
+
+  // the size counts the bytes after it, the count among them
+  if (limit - src - 1 - width < size || size < width) return -1;
+  *end = src + 1 + width + size;
+  *pos = src + 1 + 2*width;
+  return 0;
+}
+
 ssize_t amp_read_type(char *bytes, size_t n, amp_data_callbacks_t *cb, void *ctx, uint8_t *code)
 {
   if (bytes[0] != AMPE_DESCRIPTOR) {
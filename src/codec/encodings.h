@@ -0,0 +1,46 @@
+/* generated from src/codec/types.xml */
+#ifndef _AMP_ENCODINGS_H
+#define _AMP_ENCODINGS_H 1
+
+#define AMPE_DESCRIPTOR          (0x00)
+#define AMPE_NULL           (0x40)
+#define AMPE_BOOLEAN        (0x56)
+#define AMPE_TRUE           (0x41)
+#define AMPE_FALSE          (0x42)
+#define AMPE_UBYTE          (0x50)
+#define AMPE_USHORT         (0x60)
+#define AMPE_UINT           (0x70)
+#define AMPE_SMALLUINT      (0x52)
+#define AMPE_UINT0          (0x43)
+#define AMPE_ULONG          (0x80)
+#define AMPE_SMALLULONG     (0x53)
+#define AMPE_ULONG0         (0x44)
+#define AMPE_BYTE           (0x51)
+#define AMPE_SHORT          (0x61)
+#define AMPE_INT            (0x71)
+#define AMPE_SMALLINT       (0x54)
+#define AMPE_LONG           (0x81)
+#define AMPE_SMALLLONG      (0x55)
+#define AMPE_FLOAT          (0x72)
+#define AMPE_DOUBLE         (0x82)
+#define AMPE_DECIMAL32      (0x74)
+#define AMPE_DECIMAL64      (0x84)
+#define AMPE_DECIMAL128     (0x94)
+#define AMPE_UTF32          (0x73)
+#define AMPE_MS64           (0x83)
+#define AMPE_UUID           (0x98)
+#define AMPE_VBIN8          (0xa0)
+#define AMPE_VBIN32         (0xb0)
+#define AMPE_STR8_UTF8      (0xa1)
+#define AMPE_STR32_UTF8     (0xb1)
+#define AMPE_SYM8           (0xa3)
+#define AMPE_SYM32          (0xb3)
+#define AMPE_LIST0          (0x45)
+#define AMPE_LIST8          (0xc0)
+#define AMPE_LIST32         (0xd0)
+#define AMPE_MAP8           (0xc1)
+#define AMPE_MAP32          (0xd1)
+#define AMPE_ARRAY8         (0xe0)
+#define AMPE_ARRAY32        (0xf0)
+
+#endif /* encodings.h */
@@ -19,15 +19,38 @@
  *
  */
 
-#define _POSIX_C_SOURCE 1
+#define _GNU_SOURCE
 
 #include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define AMP_HAVE_EPOLL 1
+#define AMP_HAVE_EVENTFD 1
+#if defined(__has_include) && !defined(AMP_NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_EXT_ARG) && defined(IORING_RECV_MULTISHOT)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define AMP_HAVE_URING 1
+#endif
+#endif
+#endif
+#endif
 #include <stdio.h>
+#include <stddef.h>
 #include <time.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <amp/driver.h>
@@ -36,396 +59,2847 @@
 
 /* Decls */
 
+typedef struct amp_command_st amp_command_t;
+typedef struct amp_uring_t amp_uring_t;
+typedef struct amp_job_st amp_job_t;
+typedef struct amp_dns_entry_st amp_dns_entry_t;
+typedef struct amp_uring_req_t amp_uring_req_t;
+
+// a command with a drop hook is part of its arg, which either run or,
+// should the driver go away first, drop frees along with the command
+struct amp_command_st {
+  amp_command_t *next;
+  void (*run)(amp_driver_t *d, void *arg);
+  void (*drop)(void *arg);
+  void *arg;
+};
+
+// work handed to the resolver threads, a job is a single allocation
+// that starts with this header and belongs to its run function
+struct amp_job_st {
+  amp_job_t *next;
+  amp_job_t *prev;
+  void (*run)(amp_driver_t *d, amp_job_t *job);
+};
+
+// a slot of the driver's registry, handles carry the generation of the
+// slot they were issued for and so go stale once it is vacated
+struct amp_slot {
+  amp_selectable_t *selectable;//NULL while the slot is free
+  uint32_t generation;
+  uint32_t next_free;
+};
+
+#define NO_SLOT (UINT32_MAX)
+#define CTRL_HANDLE (UINT64_MAX)
+
+#define RESOLVER_THREADS (4)
+#define HIGH_WATER (4*1024*1024)
+#define LOW_WATER (1024*1024)
+
 struct amp_driver_t {
-  amp_selectable_t *head;
-  amp_selectable_t *tail;
+  struct amp_slot *slots;//registry of selectables, indexed by handle
+  struct pollfd *fds;//the ctrl fd, then one entry per slot, for poll
+  uint32_t slot_count;//slots handed out so far, free or not
+  uint32_t slot_capacity;
+  uint32_t free_slot;//head of the list of vacated slots
   size_t size;
-  int ctrl[2];//pipe for updating selectable status
+  amp_selectable_t *changed_head;//interest may differ from the backend's
+  amp_selectable_t *changed_tail;
+  amp_selectable_t **timers;//min-heap of selectables keyed on wakeup
+  size_t timer_count;
+  size_t timer_capacity;
+  amp_selectable_t *dead;//closed selectables, freed at the end of the pass
+  amp_selectable_t *flush_head;//selectables with writes deferred to the flush
+  amp_selectable_t *flush_tail;
+  bool coalesce;//defer engine writes to one flush per pass
+  size_t high_water;//connections stop reading above this many bytes
+  size_t low_water;//and start again once back down to this
+  time_t now;
+  int ctrl[2];//eventfd (both ends) or pipe for waking the loop
+  amp_command_t *commands;//consumer end of the command queue
+  amp_command_t *commands_tail;//producer end, shared between threads
+  amp_command_t command_stub;
+  bool woken;//a wakeup is already pending
+  int efd;//epoll instance, -1 when using poll
+  amp_uring_t *uring;//io_uring instance, NULL unless using it
+  bool reuseport;//acceptors share their port with other drivers
+  int backlog;//listen backlog for new acceptors
+  bool resolve;//look up peer names of accepted connections
+  pthread_mutex_t jobs_lock;//guards everything below
+  pthread_cond_t jobs_cond;
+  amp_job_t *jobs_head;
+  amp_job_t *jobs_tail;
+  pthread_t resolvers[RESOLVER_THREADS];//started on demand
+  int resolver_count;
+  int resolver_idle;
+  bool resolver_stop;
+  amp_dns_entry_t *dns_head;//cached lookups, oldest first
+  amp_dns_entry_t *dns_tail;
+  size_t dns_count;
+  unsigned spin_us;//busy poll this long before blocking, 0 to never spin
+  unsigned busy_poll_us;//SO_BUSY_POLL for new sockets, 0 to leave alone
+  uint32_t idle_timeout;//for the transports of new connections
+  amp_trace_ring_t *trace;//and the ring they trace to, if any
+  uint64_t spin_start;//when the current spell of spinning began, 0 if none
+  bool spinning;//the wait about to happen is a spin
+  uint64_t wait_start;//when the current wait began
+  amp_driver_stats_t stats;//written by the loop thread only
+  bool draining;
+  time_t drain_deadline;//when connections still draining are cut off
   bool stopping;
 };
 
+struct amp_pool_t {
+  size_t size;
+  amp_driver_t **drivers;
+  pthread_t *threads;
+};
+
 struct amp_selectable_st {
   amp_driver_t *driver;
-  amp_selectable_t *next;
-  amp_selectable_t *prev;
+  uint64_t handle;//generation and slot within the driver's registry
+  amp_selectable_t *dead_next;
+  amp_selectable_t *flush_next;
+  amp_selectable_t *flush_prev;
+  bool flushing;//on the driver's flush list
+  amp_selectable_t *changed_next;
+  amp_selectable_t *changed_prev;
+  bool changed;//on the driver's changed list
   int fd;
   int status;
+  int events;//interest registered with epoll, -1 if not yet registered
+  amp_uring_req_t *req;//armed io_uring poll request, if any
+  bool ring;//the io_uring does its reads and writes, see amp_uring_update
+  amp_uring_req_t *recv;//multishot recv or accept, while reading
+  amp_uring_req_t *send;//sendmsg in flight
   time_t wakeup;
+  int timer;//position in the timer heap, -1 if not scheduled
+  bool woken;//amp_selectable_wakeup was called since the last tick
+  bool draining;//shutting down gracefully, counted once it is gone
+  bool drained;//everything it had to say was written out
   void (*readable)(amp_selectable_t *s);
   void (*writable)(amp_selectable_t *s);
   time_t (*tick)(amp_selectable_t *s, time_t now);
+  // starts a graceful close, true if it wants to be waited for
+  bool (*drain)(amp_selectable_t *s);
   void (*destroy)(amp_selectable_t *s);
+  // completions of ring owned I/O, bytes are only good for the call
+  void (*received)(amp_selectable_t *s, char *bytes, ssize_t n);
+  void (*sent)(amp_selectable_t *s, ssize_t n);
+  void (*accepted)(amp_selectable_t *s, int sock);
+  amp_selectable_stats_t stats;
   void *context;
 };
 
+// relaxed stores are enough for other threads to read the driver's
+// counters, there is only ever the loop thread writing them
+#define AMP_STAT_ADD(D, FIELD, N) \
+  __atomic_store_n(&(D)->stats.FIELD, (D)->stats.FIELD + (N), __ATOMIC_RELAXED)
+#define AMP_STAT_MAX(S, FIELD, N) \
+  if ((N) > (S)->stats.FIELD) (S)->stats.FIELD = (N)
+
 /* Impls */
 
-amp_driver_t *amp_driver()
+time_t amp_now()
 {
-  amp_driver_t *d = malloc(sizeof(amp_driver_t));
-  if (!d) return NULL;
-  d->head = NULL;
-  d->tail = NULL;
-  d->size = 0;
-  d->ctrl[0] = 0;
-  d->ctrl[1] = 0;
-  d ->stopping = false;
-  return d;
+  struct timespec ts;
+  DIE_IFE(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return ((time_t) ts.tv_sec)*1000 + ts.tv_nsec/1000000;
 }
 
-void amp_driver_destroy(amp_driver_t *d)
+static uint64_t amp_now_ns()
 {
-  while (d->head)
-    amp_selectable_destroy(d->head);
-  free(d);
+  struct timespec ts;
+  DIE_IFE(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return ((uint64_t) ts.tv_sec)*1000000000 + ts.tv_nsec;
 }
 
-static void amp_driver_add(amp_driver_t *d, amp_selectable_t *s)
+static uint64_t amp_now_us()
 {
-  LL_ADD(d->head, d->tail, s);
-  s->driver = d;
-  d->size++;
+  return amp_now_ns()/1000;
 }
 
-static void amp_driver_remove(amp_driver_t *d, amp_selectable_t *s)
+#ifdef AMP_HAVE_URING
+
+// io_uring, which does the I/O of connections and acceptors itself:
+// a multishot recv per connection reading into buffers the ring picks
+// from a pool we provide, a multishot accept per acceptor, and sends
+// straight out of the transport's output. Everything queued during a
+// pass goes to the kernel together with the wait in a single
+// io_uring_enter, so a busy connection costs no syscalls of its own.
+// The control fd and connects still in progress are merely polled.
+
+#define URING_ENTRIES (256)
+#define URING_BUFS (512)//provided buffers, a power of 2
+#define URING_BUF_SIZE (4*1024)
+#define URING_BGID (0)
+#define URING_IOVS (8)
+#define URING_IGNORE (0)//user_data of requests whose completion is dropped
+#define URING_CTRL (1)//user_data of the wakeup poll
+
+struct amp_uring_req_t {
+  amp_uring_req_t *next;
+  amp_uring_req_t *prev;
+  amp_selectable_t *selectable;//NULL once released
+  int op;//the IORING_OP_* it went in as
+  int status;//interest a poll was armed with
+  bool cancelled;//a cancel is on its way, its last completion is not
+  struct msghdr msg;//for a sendmsg, along with the iovecs it points at
+  struct iovec iov[URING_IOVS];
+};
+
+struct amp_uring_t {
+  int fd;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned queued;//entries not yet submitted
+  bool ctrl_armed;
+  void *bufs;//the provided buffer ring, followed by the buffers
+  struct io_uring_buf_ring *buf_ring;
+  char *buffers;
+  unsigned short buf_tail;
+  bool registered;//the buffer ring is registered with the kernel
+  amp_uring_req_t *head;//requests the kernel still owes a completion
+  amp_uring_req_t *tail;
+};
+
+#define URING_BUFS_SIZE (URING_BUFS*sizeof(struct io_uring_buf) + URING_BUFS*URING_BUF_SIZE)
+
+static int amp_uring_register(amp_uring_t *u, unsigned opcode, void *arg, unsigned n)
 {
-  LL_REMOVE(d->head, d->tail, s);
-  s->driver = NULL;
-  d->size--;
+  return syscall(__NR_io_uring_register, u->fd, opcode, arg, n);
 }
 
-void amp_driver_run(amp_driver_t *d)
+// cancels every request matching flags (and fd) and only returns once
+// the kernel is done with them, along with the files and the memory
+// they refer to
+static int amp_uring_sync_cancel(amp_uring_t *u, int fd, unsigned flags)
+{
+  struct io_uring_sync_cancel_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.fd = fd;
+  reg.flags = flags;
+  reg.timeout.tv_sec = -1;
+  reg.timeout.tv_nsec = -1;
+  return amp_uring_register(u, IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+}
+
+// hands a buffer back to the kernel once its contents are consumed
+static void amp_uring_buf_return(amp_uring_t *u, unsigned short bid)
 {
-  int i, nfds = 0;
-  struct pollfd *fds = NULL;
+  struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & (URING_BUFS - 1)];
+  buf->addr = (uint64_t) (uintptr_t) (u->buffers + (size_t) bid*URING_BUF_SIZE);
+  buf->len = URING_BUF_SIZE;
+  buf->bid = bid;
+  __atomic_store_n(&u->buf_ring->tail, ++u->buf_tail, __ATOMIC_RELEASE);
+}
 
-  if (pipe(d->ctrl)) {
-      perror("Can't create control pipe");
+static void amp_uring_free(amp_uring_t *u)
+{
+  // a request left behind would keep its fd open, a listening socket
+  // say, until the ring's teardown gets round to it
+  if (u->sq_ring != MAP_FAILED)
+    amp_uring_sync_cancel(u, -1, IORING_ASYNC_CANCEL_ANY);
+  if (u->registered) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = URING_BGID;
+    amp_uring_register(u, IORING_UNREGISTER_PBUF_RING, &reg, 1);
   }
-  while (!d->stopping)
-  {
-    int n = d->size;
-    if (n == 0) break;
-    if (n > nfds) {
-      fds = realloc(fds, (n+1)*sizeof(struct pollfd));
-      nfds = n;
-    }
+  while (u->head) {
+    amp_uring_req_t *req = u->head;
+    LL_REMOVE(u->head, u->tail, req);
+    free(req);
+  }
+  if (u->bufs != MAP_FAILED) munmap(u->bufs, URING_BUFS_SIZE);
+  if (u->sqes != MAP_FAILED) munmap(u->sqes, u->sqes_size);
+  if (u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+    munmap(u->cq_ring, u->cq_ring_size);
+  if (u->sq_ring != MAP_FAILED) munmap(u->sq_ring, u->sq_ring_size);
+  close(u->fd);
+  free(u);
+}
 
-    amp_selectable_t *s = d->head;
-    for (i = 0; i < n; i++)
-    {
-      fds[i].fd = s->fd;
-      fds[i].events = (s->status & AMP_SEL_RD ? POLLIN : 0) |
-        (s->status & AMP_SEL_WR ? POLLOUT : 0);
-      fds[i].revents = 0;
-      if (s->tick) {
-        // XXX
-        s->tick(s, 0);
-      }
-      s = s->next;
-    }
-    fds[n].fd = d->ctrl[0];
-    fds[n].events = POLLIN;
-    fds[n].revents = 0;
+// everything we use was in by the time IORING_REGISTER_SYNC_CANCEL
+// came along (6.0), multishot recv included, so a kernel that takes a
+// cancel that finds nothing without EINVAL has all of it
+static int amp_uring_setup_bufs(amp_uring_t *u)
+{
+  u->bufs = mmap(NULL, URING_BUFS_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (u->bufs == MAP_FAILED) return -1;
+  u->buf_ring = u->bufs;
+  u->buffers = (char *) u->bufs + URING_BUFS*sizeof(struct io_uring_buf);
+  u->buf_tail = 0;
 
-    DIE_IFE(poll(fds, n+1, -1));
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t) (uintptr_t) u->buf_ring;
+  reg.ring_entries = URING_BUFS;
+  reg.bgid = URING_BGID;
+  if (amp_uring_register(u, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) return -1;
+  u->registered = true;
+  for (unsigned i = 0; i < URING_BUFS; i++)
+    amp_uring_buf_return(u, i);
 
-    s = d->head;
-    for (i = 0; i < n; i++)
-    {
-      if (fds[i].revents & POLLIN)
-        s->readable(s);
-      if (fds[i].revents & POLLOUT)
-        s->writable(s);
-      s = s->next;
-    }
+  if (amp_uring_sync_cancel(u, -1, IORING_ASYNC_CANCEL_ANY) == -1 && errno != ENOENT) {
+    errno = ENOSYS;
+    return -1;
+  }
+  return 0;
+}
 
-    if (fds[n].revents & POLLIN) {
-      //clear the pipe
-      char buffer[512];
-      while (read(d->ctrl[0], buffer, 512) == 512);
-    }
+static amp_uring_t *amp_uring()
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+  if (fd == -1) return NULL;
+  // the wait timeout needs IORING_ENTER_EXT_ARG
+  if (!(p.features & IORING_FEAT_EXT_ARG)) {
+    close(fd);
+    errno = ENOSYS;
+    return NULL;
   }
 
-  close(d->ctrl[0]);
-  close(d->ctrl[1]);
-  free(fds);
+  amp_uring_t *u = malloc(sizeof(amp_uring_t));
+  if (!u) {
+    close(fd);
+    return NULL;
+  }
+  u->fd = fd;
+  u->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  u->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  u->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+    u->cq_ring_size = u->sq_ring_size;
+  }
+  u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (p.features & IORING_FEAT_SINGLE_MMAP || u->sq_ring == MAP_FAILED)
+    u->cq_ring = u->sq_ring;
+  else
+    u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  u->bufs = MAP_FAILED;
+  u->registered = false;
+  u->head = NULL;
+  u->tail = NULL;
+  if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || u->sqes == MAP_FAILED ||
+      amp_uring_setup_bufs(u) == -1) {
+    int err = errno;
+    amp_uring_free(u);
+    errno = err;
+    return NULL;
+  }
+
+  char *sq = u->sq_ring, *cq = u->cq_ring;
+  u->sq_head = (unsigned *) (sq + p.sq_off.head);
+  u->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  u->sq_array = (unsigned *) (sq + p.sq_off.array);
+  u->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+  u->sq_entries = p.sq_entries;
+  u->cq_head = (unsigned *) (cq + p.cq_off.head);
+  u->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  u->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  u->queued = 0;
+  u->ctrl_armed = false;
+  return u;
 }
 
-void amp_driver_stop(amp_driver_t *d)
+// submits everything queued and, when wait is set, blocks for at least
+// one completion or until timeout milliseconds (-1 for no limit) pass
+static int amp_uring_enter(amp_uring_t *u, bool wait, int timeout)
 {
-  d->stopping = true;
-  write(d->ctrl[1], "x", 1);
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  unsigned flags = IORING_ENTER_EXT_ARG;
+  if (wait) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout >= 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000L;
+      arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+  }
+  int n = syscall(__NR_io_uring_enter, u->fd, u->queued, wait ? 1 : 0, flags,
+                  &arg, sizeof(arg));
+  if (n > 0) u->queued -= n;
+  return n;
 }
 
-static amp_selectable_t *amp_selectable()
+// without SQPOLL the kernel only reads the submission ring inside
+// io_uring_enter, so entries can be published before they are filled
+static struct io_uring_sqe *amp_uring_sqe(amp_uring_t *u)
 {
-  amp_selectable_t *s = malloc(sizeof(amp_selectable_t));
-  if (!s) return NULL;
-  s->driver = NULL;
-  s->next = NULL;
-  s->prev = NULL;
-  s->status = 0;
-  s->wakeup = 0;
-  s->readable = NULL;
-  s->writable = NULL;
-  s->tick = NULL;
-  s->destroy = NULL;
-  s->context = NULL;
-  return s;
+  unsigned tail = *u->sq_tail;
+  if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    DIE_IFE(amp_uring_enter(u, false, 0));
+  unsigned index = tail & u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[index] = index;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  u->queued++;
+  return sqe;
 }
 
-void amp_selectable_destroy(amp_selectable_t *s)
+static void amp_uring_poll(amp_uring_t *u, int fd, int status, uint64_t data)
 {
-  if (s->driver) amp_driver_remove(s->driver, s);
-  if (s->destroy) s->destroy(s);
-  free(s);
+  uint32_t events = (status & AMP_SEL_RD ? POLLIN : 0) |
+    (status & AMP_SEL_WR ? POLLOUT : 0) | (status & AMP_SEL_HUP ? POLLRDHUP : 0);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  events = __builtin_bswap32(events) >> 16 | __builtin_bswap32(events) << 16;
+#endif
+  struct io_uring_sqe *sqe = amp_uring_sqe(u);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->user_data = data;
 }
 
-// engine related
-
-#define IO_BUF_SIZE (4*1024)
-
-struct amp_engine_ctx {
-  amp_connection_t *connection;
-  amp_transport_t *transport;
-  int in_size;
-  int out_size;
-  char input[IO_BUF_SIZE];
-  char output[IO_BUF_SIZE];
-  void (*callback)(amp_connection_t*, void*);
-  void *context;
-};
-
-static void amp_selectable_engine_close(amp_selectable_t *sel)
+// a request stays on the list until its last completion comes back,
+// the kernel may still be holding on to it until then
+static amp_uring_req_t *amp_uring_req(amp_uring_t *u, amp_selectable_t *s, int op)
 {
-  sel->status = 0;
-  if (close(sel->fd) == -1)
-    perror("close");
-  amp_driver_remove(sel->driver, sel);
-  amp_selectable_destroy(sel);
+  amp_uring_req_t *req = malloc(sizeof(amp_uring_req_t));
+  if (!req) return NULL;
+  req->selectable = s;
+  req->op = op;
+  req->status = 0;
+  req->cancelled = false;
+  LL_ADD(u->head, u->tail, req);
+  return req;
 }
 
-static struct amp_engine_ctx *amp_selectable_engine_read(amp_selectable_t *sel)
+static void amp_uring_cancel(amp_uring_t *u, amp_uring_req_t *req)
 {
-  struct amp_engine_ctx *ctx = sel->context;
-  ssize_t n = recv(sel->fd, ctx->input + ctx->in_size, IO_BUF_SIZE - ctx->in_size, 0);
+  struct io_uring_sqe *sqe = amp_uring_sqe(u);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = (uint64_t) (uintptr_t) req;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = URING_IGNORE;
+  req->cancelled = true;
+}
 
-  if (n <= 0) {
-    printf("disconnected: %zi\n", n);
-    amp_selectable_engine_close(sel);
-    return NULL;
+// a multishot accept for acceptors, a multishot recv into provided
+// buffers for everything else, both keep going until cancelled
+static void amp_uring_recv(amp_uring_t *u, amp_selectable_t *s)
+{
+  amp_uring_req_t *req = amp_uring_req(u, s, s->accepted ? IORING_OP_ACCEPT : IORING_OP_RECV);
+  if (!req) return;
+  struct io_uring_sqe *sqe = amp_uring_sqe(u);
+  sqe->opcode = req->op;
+  sqe->fd = s->fd;
+  if (s->accepted) {
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
   } else {
-    ctx->in_size += n;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
   }
-  return ctx;
+  sqe->user_data = (uint64_t) (uintptr_t) req;
+  s->recv = req;
 }
 
-static void amp_selectable_engine_consume(struct amp_engine_ctx *ctx, int n)
+// the iovecs must stay good until the send completes, the selectable
+// only ever has one in flight so its output goes out in order
+static int amp_uring_send(amp_uring_t *u, amp_selectable_t *s, struct iovec *iov,
+                          int count)
 {
-  ctx->in_size -= n;
-  memmove(ctx->input, ctx->input + n, ctx->in_size);
+  if (count > URING_IOVS) count = URING_IOVS;
+  amp_uring_req_t *req = amp_uring_req(u, s, IORING_OP_SENDMSG);
+  if (!req) return -1;
+  memcpy(req->iov, iov, count*sizeof(struct iovec));
+  memset(&req->msg, 0, sizeof(req->msg));
+  req->msg.msg_iov = req->iov;
+  req->msg.msg_iovlen = count;
+  struct io_uring_sqe *sqe = amp_uring_sqe(u);
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = s->fd;
+  sqe->addr = (uint64_t) (uintptr_t) &req->msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = (uint64_t) (uintptr_t) req;
+  s->send = req;
+  return 0;
 }
 
-static void amp_engine_readable_input(amp_selectable_t *sel, struct amp_engine_ctx *ctx)
+static void amp_uring_detach(amp_uring_req_t **req)
 {
-  amp_transport_t *transport = ctx->transport;
-  ssize_t n = amp_input(transport, ctx->input, ctx->in_size);
-  if (n < 0) {
-    if (n != EOS) {
-      printf("error: %zi\n", n);
-    }
-    amp_selectable_engine_close(sel);
-  } else {
-    amp_selectable_engine_consume(ctx, n);
-  }
+  if (!*req) return;
+  (*req)->selectable = NULL;
+  *req = NULL;
 }
 
-static void amp_engine_readable(amp_selectable_t *sel)
+// lets go of everything the kernel holds for the selectable's fd, by
+// the time this returns the fd can be closed and the memory sends
+// pointed at freed
+static void amp_uring_release(amp_uring_t *u, amp_selectable_t *s)
 {
-  struct amp_engine_ctx *ctx = amp_selectable_engine_read(sel);
-  if (ctx) amp_engine_readable_input(sel, ctx);
+  amp_uring_detach(&s->req);
+  amp_uring_detach(&s->recv);
+  amp_uring_detach(&s->send);
+  if (s->fd == -1) return;
+  // entries still queued would otherwise go in after the fd is closed
+  if (u->queued) amp_uring_enter(u, false, 0);
+  amp_uring_sync_cancel(u, s->fd, IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL);
 }
 
-static void amp_engine_readable_hdr(amp_selectable_t *sel)
+// polls are one shot, so this also rearms whatever fired last pass,
+// while a selectable whose I/O the ring does only needs telling when
+// to start or stop reading, its sends go in as they are made
+static void amp_uring_update(amp_uring_t *u, amp_selectable_t *s)
 {
-  struct amp_engine_ctx *ctx = amp_selectable_engine_read(sel);
-
-  if (!ctx)
+  int status = s->fd == -1 ? 0 : s->status & (AMP_SEL_RD | AMP_SEL_WR | AMP_SEL_HUP);
+  if (s->ring) {
+    // with reading paused a poll is left to catch the peer hanging up,
+    // armed once the recv is done, as it reads off the socket itself
+    bool hup = !(status & AMP_SEL_RD) && status & AMP_SEL_HUP && !s->recv;
+    if (s->req && !hup) {
+      amp_uring_cancel(u, s->req);
+      amp_uring_detach(&s->req);
+    }
+    // a stopped recv may still hand over what it had read, so a new one
+    // only goes in after its last completion
+    if (status & AMP_SEL_RD) {
+      if (!s->recv) amp_uring_recv(u, s);
+    } else if (s->recv && !s->recv->cancelled) {
+      amp_uring_cancel(u, s->recv);
+    }
+    if (hup && !s->req) {
+      amp_uring_req_t *req = amp_uring_req(u, s, IORING_OP_POLL_ADD);
+      if (!req) return;
+      req->status = AMP_SEL_HUP;
+      s->req = req;
+      amp_uring_poll(u, s->fd, AMP_SEL_HUP, (uint64_t) (uintptr_t) req);
+    }
     return;
+  }
 
-  if (ctx->in_size >= 8) {
-    if (memcmp(ctx->input, "AMQP\x00\x01\x00\x00", 8)) {
-      printf("header missmatch");
-      amp_selectable_engine_close(sel);
-    } else {
-      amp_selectable_engine_consume(ctx, 8);
-      sel->readable = &amp_engine_readable;
-      amp_engine_readable_input(sel, ctx);
-    }
+  if (s->req && s->req->status == status) return;
+  if (s->req) {
+    amp_uring_cancel(u, s->req);
+    amp_uring_detach(&s->req);
   }
+  if (!status) return;
+  amp_uring_req_t *req = amp_uring_req(u, s, IORING_OP_POLL_ADD);
+  if (!req) return;
+  req->status = status;
+  s->req = req;
+  amp_uring_poll(u, s->fd, status, (uint64_t) (uintptr_t) req);
 }
 
-static void amp_engine_writable(amp_selectable_t *sel)
+#endif
+
+amp_driver_t *amp_driver_backend(amp_backend_t backend)
 {
-  struct amp_engine_ctx *ctx = sel->context;
-  amp_transport_t *transport = ctx->transport;
-  ssize_t n = amp_output(transport, ctx->output + ctx->out_size, IO_BUF_SIZE - ctx->out_size);
-  if (n < 0) {
-    printf("internal error: %zi", n);
-    amp_selectable_engine_close(sel);
-  } else {
-    ctx->out_size += n;
-    n = send(sel->fd, ctx->output, ctx->out_size, 0);
-    if (n < 0) {
-      // XXX
-      perror("writable");
-    } else {
-      ctx->out_size -= n;
-      memmove(ctx->output, ctx->output + n, ctx->out_size);
-    }
-    if (ctx->out_size)
-      sel->status |= AMP_SEL_WR;
-    else
-      sel->status &= ~AMP_SEL_WR;
+  amp_driver_t *d = malloc(sizeof(amp_driver_t));
+  if (!d) return NULL;
+  d->slots = NULL;
+  d->fds = NULL;
+  d->slot_count = 0;
+  d->slot_capacity = 0;
+  d->free_slot = NO_SLOT;
+  d->size = 0;
+  d->changed_head = NULL;
+  d->changed_tail = NULL;
+  d->timers = NULL;
+  d->timer_count = 0;
+  d->timer_capacity = 0;
+  d->dead = NULL;
+  d->flush_head = NULL;
+  d->flush_tail = NULL;
+  d->coalesce = false;
+  d->high_water = HIGH_WATER;
+  d->low_water = LOW_WATER;
+  d->now = amp_now();
+  d->efd = -1;
+  d->uring = NULL;
+  d->reuseport = false;
+  d->backlog = SOMAXCONN;
+  d->resolve = false;
+  pthread_mutex_init(&d->jobs_lock, NULL);
+  pthread_cond_init(&d->jobs_cond, NULL);
+  d->jobs_head = NULL;
+  d->jobs_tail = NULL;
+  d->resolver_count = 0;
+  d->resolver_idle = 0;
+  d->resolver_stop = false;
+  d->dns_head = NULL;
+  d->dns_tail = NULL;
+  d->dns_count = 0;
+  d->spin_us = 0;
+  d->busy_poll_us = 0;
+  d->idle_timeout = 0;
+  d->trace = NULL;
+  d->spin_start = 0;
+  d->spinning = false;
+  d->wait_start = 0;
+  memset(&d->stats, 0, sizeof(d->stats));
+  d->draining = false;
+  d->drain_deadline = 0;
+  d->stopping = false;
+  d->command_stub.next = NULL;
+  d->commands = &d->command_stub;
+  d->commands_tail = &d->command_stub;
+  d->woken = false;
+#ifdef AMP_HAVE_EVENTFD
+  d->ctrl[0] = d->ctrl[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (d->ctrl[0] == -1) {
+    perror("Can't create control eventfd");
+    free(d);
+    return NULL;
+  }
+#else
+  if (pipe(d->ctrl) || fcntl(d->ctrl[0], F_SETFL, O_NONBLOCK)) {
+    perror("Can't create control pipe");
+    free(d);
+    return NULL;
+  }
+#endif
+#ifdef AMP_HAVE_URING
+  if (backend == AMP_URING && !(d->uring = amp_uring()))
+    perror("io_uring, falling back to epoll");
+#endif
+#ifdef AMP_HAVE_EPOLL
+  if (backend != AMP_POLL && !d->uring) {
+    d->efd = epoll_create1(EPOLL_CLOEXEC);
+    if (d->efd == -1)
+      perror("epoll_create1, falling back to poll");
   }
+#endif
+  return d;
 }
 
-static time_t amp_selectable_engine_tick(amp_selectable_t *sel, time_t now)
+amp_driver_t *amp_driver()
 {
-  struct amp_engine_ctx *ctx = sel->context;
-  time_t result = amp_tick(ctx->transport, now);
-  if (ctx->callback) ctx->callback(ctx->connection, ctx->context);
-  amp_engine_writable(sel);
-  return result;
+  const char *name = getenv("AMP_DRIVER");
+  amp_driver_t *d;
+  if (name && !strcmp(name, "poll"))
+    d = amp_driver_backend(AMP_POLL);
+  else if (name && !strcmp(name, "uring"))
+    d = amp_driver_backend(AMP_URING);
+  else
+    d = amp_driver_backend(AMP_EPOLL);
+  const char *spin = getenv("AMP_SPIN");
+  if (d && spin) amp_driver_set_busy_poll(d, atoi(spin), 0);
+  return d;
 }
 
-static void amp_engine_destroy(amp_selectable_t *s)
+amp_backend_t amp_driver_get_backend(amp_driver_t *d)
 {
-  struct amp_engine_ctx *ctx = s->context;
-  if (ctx) {
-    amp_destroy((amp_endpoint_t *)ctx->connection);
-    free(ctx);
-    s->context = NULL;
-  }
+  if (d->uring) return AMP_URING;
+  return d->efd == -1 ? AMP_POLL : AMP_EPOLL;
 }
 
-static amp_selectable_t *amp_selectable_engine(int sock, amp_connection_t *conn,
-                                               void (*cb)(amp_connection_t*, void*), void* ctx)
+// command queue, an intrusive multi-producer single-consumer queue:
+// producers only ever swap themselves in as the tail and then link the
+// previous tail to them, the loop thread is the only consumer
+
+static void amp_driver_push(amp_driver_t *d, amp_command_t *cmd)
 {
-  amp_selectable_t *sel = amp_selectable();
-  sel->fd = sock;
-  sel->readable = &amp_engine_readable_hdr;
-  sel->writable = &amp_engine_writable;
-  sel->destroy = &amp_engine_destroy;
-  sel->tick = &amp_selectable_engine_tick;
-  sel->status = AMP_SEL_RD | AMP_SEL_WR;
-  struct amp_engine_ctx *sctx = malloc(sizeof(struct amp_engine_ctx));
-  sctx->connection = conn;
-  sctx->transport = amp_transport(conn);
-  sctx->in_size = 0;
-  memmove(sctx->output, "AMQP\x00\x01\x00\x00", 8);
-  sctx->out_size = 8;
-  sctx->callback = cb;
-  sctx->context = ctx;
-  sel->context = sctx;
-  return sel;
+  __atomic_store_n(&cmd->next, NULL, __ATOMIC_RELAXED);
+  amp_command_t *prev = __atomic_exchange_n(&d->commands_tail, cmd, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, cmd, __ATOMIC_RELEASE);
 }
 
-amp_selectable_t *amp_connector(amp_driver_t *drv, char *host, char *port,
-                                void (*cb)(amp_connection_t*, void*), void* ctx)
+// returns NULL when the queue is empty or a producer is half way
+// through a push, in the latter case its wakeup is still to come
+static amp_command_t *amp_driver_pop(amp_driver_t *d)
 {
-  struct addrinfo *addr;
-  int code = getaddrinfo(host, port, NULL, &addr);
-  if (code) {
-    fprintf(stderr, "%s", gai_strerror(code));
-    return NULL;
+  amp_command_t *head = d->commands;
+  amp_command_t *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+  if (head == &d->command_stub) {
+    if (!next) return NULL;
+    d->commands = head = next;
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
   }
 
-  int sock = socket(AF_INET, SOCK_STREAM, getprotobyname("tcp")->p_proto);
-  if (sock == -1)
-    return NULL;
+  if (next) {
+    d->commands = next;
+    return head;
+  }
 
-  if (connect(sock, addr->ai_addr, addr->ai_addrlen) == -1) {
-    freeaddrinfo(addr);
+  if (head != __atomic_load_n(&d->commands_tail, __ATOMIC_ACQUIRE))
     return NULL;
+
+  amp_driver_push(d, &d->command_stub);
+  next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+  if (next) {
+    d->commands = next;
+    return head;
   }
+  return NULL;
+}
 
-  freeaddrinfo(addr);
+static void amp_driver_wake(amp_driver_t *d)
+{
+  if (__atomic_exchange_n(&d->woken, true, __ATOMIC_SEQ_CST)) return;
+#ifdef AMP_HAVE_EVENTFD
+  uint64_t one = 1;
+  write(d->ctrl[1], &one, sizeof(one));
+#else
+  write(d->ctrl[1], "x", 1);
+#endif
+}
 
-  amp_connection_t *conn = amp_connection();
-  amp_selectable_t *s = amp_selectable_engine(sock, conn, cb, ctx);
+static bool amp_driver_stopping(amp_driver_t *d)
+{
+  return __atomic_load_n(&d->stopping, __ATOMIC_SEQ_CST);
+}
 
-  amp_driver_add(drv, s);
-  printf("Connected to %s:%s\n", host, port);
-  return s;
+static void amp_driver_send(amp_driver_t *d, amp_command_t *cmd)
+{
+  amp_driver_push(d, cmd);
+  amp_driver_wake(d);
 }
 
-static void do_accept(amp_selectable_t *s)
+int amp_driver_post(amp_driver_t *d, void (*run)(amp_driver_t *d, void *arg), void *arg)
 {
-  struct sockaddr_in addr = {0};
-  addr.sin_family = AF_INET;
-  socklen_t addrlen = sizeof(addr);
-  int sock = accept(s->fd, (struct sockaddr *) &addr, &addrlen);
-  if (sock == -1) {
-    perror("accept");
-  } else {
-    char host[1024], serv[64];
-    int code;
-    if ((code = getnameinfo((struct sockaddr *) &addr, addrlen, host, 1024, serv, 64, 0))) {
-      printf("getnameinfo: %s\n", gai_strerror(code));
-      if (close(sock) == -1)
-        perror("close");
-    } else {
-      printf("accepted from %s:%s\n", host, serv);
-      amp_connection_t *conn = amp_connection();
-      struct amp_engine_ctx *ctx = s->context;
-      amp_selectable_t *a = amp_selectable_engine(sock, conn, ctx->callback, ctx->context);
-      a->status = AMP_SEL_RD | AMP_SEL_WR;
-      amp_driver_add(s->driver, a);
+  amp_command_t *cmd = malloc(sizeof(amp_command_t));
+  if (!cmd) return -1;
+  cmd->run = run;
+  cmd->drop = NULL;
+  cmd->arg = arg;
+  amp_driver_send(d, cmd);
+  return 0;
+}
+
+// resolver, a few threads for the blocking name lookups that must
+// never run on the loop thread
+
+static void *amp_resolver_thread(void *arg)
+{
+  amp_driver_t *d = arg;
+  pthread_mutex_lock(&d->jobs_lock);
+  while (true) {
+    while (!d->jobs_head && !d->resolver_stop) {
+      d->resolver_idle++;
+      pthread_cond_wait(&d->jobs_cond, &d->jobs_lock);
+      d->resolver_idle--;
     }
+    if (d->resolver_stop) break;
+    amp_job_t *job = d->jobs_head;
+    LL_POP(d->jobs_head, d->jobs_tail);
+    pthread_mutex_unlock(&d->jobs_lock);
+    job->run(d, job);
+    pthread_mutex_lock(&d->jobs_lock);
   }
+  pthread_mutex_unlock(&d->jobs_lock);
+  return NULL;
 }
 
-amp_selectable_t *amp_acceptor(amp_driver_t *drv, char *host, char *port,
-                               void (*cb)(amp_connection_t*, void*), void* context)
+// safe from any thread, the job is freed if it cannot be queued
+static int amp_resolver_submit(amp_driver_t *d, amp_job_t *job)
 {
-  struct addrinfo *addr;
-  int code = getaddrinfo(host, port, NULL, &addr);
-  if (code) {
-    fprintf(stderr, "%s", gai_strerror(code));
-    return NULL;
+  int result = 0;
+  pthread_mutex_lock(&d->jobs_lock);
+  if (d->resolver_stop) {
+    result = -1;
+  } else if (!d->resolver_idle && d->resolver_count < RESOLVER_THREADS &&
+             !pthread_create(&d->resolvers[d->resolver_count], NULL, amp_resolver_thread, d)) {
+    d->resolver_count++;
+  } else if (!d->resolver_count) {
+    result = -1;
+  }
+  if (!result) {
+    LL_ADD(d->jobs_head, d->jobs_tail, job);
+    pthread_cond_signal(&d->jobs_cond);
   }
+  pthread_mutex_unlock(&d->jobs_lock);
+  if (result) free(job);
+  return result;
+}
 
-  int sock = socket(AF_INET, SOCK_STREAM, getprotobyname("tcp")->p_proto);
-  if (sock == -1)
-    return NULL;
+// waits for lookups already underway, queued ones are dropped
+static void amp_resolver_stop(amp_driver_t *d)
+{
+  pthread_mutex_lock(&d->jobs_lock);
+  d->resolver_stop = true;
+  pthread_cond_broadcast(&d->jobs_cond);
+  pthread_mutex_unlock(&d->jobs_lock);
+  for (int i = 0; i < d->resolver_count; i++)
+    DIE_IFR(pthread_join(d->resolvers[i], NULL), strerror);
+  d->resolver_count = 0;
+  while (d->jobs_head) {
+    amp_job_t *job = d->jobs_head;
+    LL_POP(d->jobs_head, d->jobs_tail);
+    free(job);
+  }
+}
 
-  int optval = 1;
-  if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1)
-    return NULL;
+// resolution cache, only ever touched from the loop thread
 
-  if (bind(sock, addr->ai_addr, addr->ai_addrlen) == -1) {
-    freeaddrinfo(addr);
-    return NULL;
+#define DNS_TTL (60*1000)
+#define DNS_ENTRIES (64)
+
+struct amp_addr {
+  int family;
+  int protocol;
+  socklen_t addrlen;
+  struct sockaddr_storage addr;
+};
+
+struct amp_dns_entry_st {
+  amp_dns_entry_t *next;
+  amp_dns_entry_t *prev;
+  char *host;
+  char *port;
+  struct amp_addr *addrs;
+  size_t count;
+  time_t expires;
+};
+
+static struct amp_addr *amp_addrs(const struct addrinfo *ai, size_t *count)
+{
+  size_t n = 0;
+  for (const struct addrinfo *a = ai; a; a = a->ai_next) n++;
+  struct amp_addr *addrs = malloc((n ? n : 1)*sizeof(struct amp_addr));
+  *count = 0;
+  if (!addrs) return NULL;
+  for (const struct addrinfo *a = ai; a; a = a->ai_next) {
+    if (a->ai_socktype != SOCK_STREAM || a->ai_addrlen > sizeof(struct sockaddr_storage))
+      continue;
+    struct amp_addr *addr = &addrs[(*count)++];
+    addr->family = a->ai_family;
+    addr->protocol = a->ai_protocol;
+    addr->addrlen = a->ai_addrlen;
+    memcpy(&addr->addr, a->ai_addr, a->ai_addrlen);
   }
+  return addrs;
+}
 
-  freeaddrinfo(addr);
+static void amp_dns_free(amp_dns_entry_t *e)
+{
+  free(e->host);
+  free(e->port);
+  free(e->addrs);
+  free(e);
+}
 
-  if (listen(sock, 50) == -1)
+static void amp_dns_evict(amp_driver_t *d, amp_dns_entry_t *e)
+{
+  LL_REMOVE(d->dns_head, d->dns_tail, e);
+  d->dns_count--;
+  amp_dns_free(e);
+}
+
+static amp_dns_entry_t *amp_dns_get(amp_driver_t *d, const char *host, const char *port)
+{
+  for (amp_dns_entry_t *e = d->dns_head; e; e = e->next) {
+    if (strcmp(e->host, host) || strcmp(e->port, port)) continue;
+    if (e->expires > amp_now()) return e;
+    amp_dns_evict(d, e);
     return NULL;
+  }
+  return NULL;
+}
 
-  amp_selectable_t *s = amp_selectable();
-  s->fd = sock;
-  s->readable = &do_accept;
-  s->writable = NULL;
-  s->status = AMP_SEL_RD;
-  struct amp_engine_ctx *ctx = malloc(sizeof(struct amp_engine_ctx));
-  ctx->callback = cb;
-  ctx->context = context;
-  s->context = ctx;
+static void amp_dns_put(amp_driver_t *d, const char *host, const char *port,
+                        const struct amp_addr *addrs, size_t count)
+{
+  if (!count) return;
+  amp_dns_entry_t *e = amp_dns_get(d, host, port);
+  if (e) amp_dns_evict(d, e);
+  if (d->dns_count == DNS_ENTRIES) amp_dns_evict(d, d->dns_head);
 
-  amp_driver_add(drv, s);
-  printf("Listening on %s:%s\n", host, port);
+  e = malloc(sizeof(amp_dns_entry_t));
+  if (!e) return;
+  e->host = strdup(host);
+  e->port = strdup(port);
+  e->addrs = malloc(count*sizeof(struct amp_addr));
+  if (!e->host || !e->port || !e->addrs) {
+    amp_dns_free(e);
+    return;
+  }
+  memcpy(e->addrs, addrs, count*sizeof(struct amp_addr));
+  e->count = count;
+  e->expires = amp_now() + DNS_TTL;
+  LL_ADD(d->dns_head, d->dns_tail, e);
+  d->dns_count++;
+}
+
+static void amp_driver_reap(amp_driver_t *d)
+{
+  while (d->dead) {
+    amp_selectable_t *s = d->dead;
+    d->dead = s->dead_next;
+    amp_selectable_destroy(s);
+  }
+}
+
+void amp_driver_destroy(amp_driver_t *d)
+{
+  for (uint32_t i = 0; i < d->slot_count; i++)
+    if (d->slots[i].selectable)
+      amp_selectable_destroy(d->slots[i].selectable);
+  amp_driver_reap(d);
+  // after the selectables, so connectors stop waiting on lookups first
+  amp_resolver_stop(d);
+  while (d->dns_head) {
+    amp_dns_entry_t *e = d->dns_head;
+    LL_REMOVE(d->dns_head, d->dns_tail, e);
+    amp_dns_free(e);
+  }
+  if (d->efd != -1) close(d->efd);
+#ifdef AMP_HAVE_URING
+  if (d->uring) amp_uring_free(d->uring);
+#endif
+  close(d->ctrl[0]);
+  if (d->ctrl[1] != d->ctrl[0]) close(d->ctrl[1]);
+  amp_command_t *cmd;
+  while ((cmd = amp_driver_pop(d))) {
+    if (cmd->drop)
+      cmd->drop(cmd->arg);
+    else
+      free(cmd);
+  }
+  free(d->timers);
+  free(d->slots);
+  free(d->fds);
+  pthread_cond_destroy(&d->jobs_cond);
+  pthread_mutex_destroy(&d->jobs_lock);
+  free(d);
+}
+
+void amp_driver_set_backlog(amp_driver_t *d, int backlog)
+{
+  d->backlog = backlog;
+}
+
+void amp_driver_set_resolve(amp_driver_t *d, bool resolve)
+{
+  d->resolve = resolve;
+}
+
+void amp_driver_set_watermarks(amp_driver_t *d, size_t high, size_t low)
+{
+  d->high_water = high;
+  d->low_water = low < high ? low : high;
+}
+
+void amp_driver_set_coalesce(amp_driver_t *d, bool coalesce)
+{
+  d->coalesce = coalesce;
+}
+
+void amp_driver_set_busy_poll(amp_driver_t *d, unsigned spin_us, unsigned busy_poll_us)
+{
+  d->spin_us = spin_us;
+  d->busy_poll_us = busy_poll_us;
+}
+
+void amp_driver_set_idle_timeout(amp_driver_t *d, uint32_t timeout)
+{
+  d->idle_timeout = timeout;
+}
+
+void amp_driver_set_trace(amp_driver_t *d, amp_trace_ring_t *ring)
+{
+  d->trace = ring;
+}
+
+amp_driver_stats_t amp_driver_stats(amp_driver_t *d)
+{
+  amp_driver_stats_t stats;
+  stats.iterations = __atomic_load_n(&d->stats.iterations, __ATOMIC_RELAXED);
+  stats.wait_ns = __atomic_load_n(&d->stats.wait_ns, __ATOMIC_RELAXED);
+  stats.handler_ns = __atomic_load_n(&d->stats.handler_ns, __ATOMIC_RELAXED);
+  stats.handler_max_ns = __atomic_load_n(&d->stats.handler_max_ns, __ATOMIC_RELAXED);
+  stats.commands = __atomic_load_n(&d->stats.commands, __ATOMIC_RELAXED);
+  stats.spins = __atomic_load_n(&d->stats.spins, __ATOMIC_RELAXED);
+  stats.hits = __atomic_load_n(&d->stats.hits, __ATOMIC_RELAXED);
+  stats.drained = __atomic_load_n(&d->stats.drained, __ATOMIC_RELAXED);
+  stats.abandoned = __atomic_load_n(&d->stats.abandoned, __ATOMIC_RELAXED);
+  return stats;
+}
+
+// timers
+
+static void amp_timer_set(amp_driver_t *d, size_t i, amp_selectable_t *s)
+{
+  d->timers[i] = s;
+  s->timer = i;
+}
+
+static void amp_timer_up(amp_driver_t *d, size_t i)
+{
+  amp_selectable_t *s = d->timers[i];
+  while (i > 0) {
+    size_t parent = (i - 1)/2;
+    if (d->timers[parent]->wakeup <= s->wakeup) break;
+    amp_timer_set(d, i, d->timers[parent]);
+    i = parent;
+  }
+  amp_timer_set(d, i, s);
+}
+
+static void amp_timer_down(amp_driver_t *d, size_t i)
+{
+  amp_selectable_t *s = d->timers[i];
+  while (true) {
+    size_t child = 2*i + 1;
+    if (child >= d->timer_count) break;
+    if (child + 1 < d->timer_count &&
+        d->timers[child + 1]->wakeup < d->timers[child]->wakeup)
+      child++;
+    if (s->wakeup <= d->timers[child]->wakeup) break;
+    amp_timer_set(d, i, d->timers[child]);
+    i = child;
+  }
+  amp_timer_set(d, i, s);
+}
+
+static void amp_timer_cancel(amp_driver_t *d, amp_selectable_t *s)
+{
+  if (s->timer < 0) return;
+  size_t i = s->timer;
+  amp_selectable_t *last = d->timers[--d->timer_count];
+  s->timer = -1;
+  if (last != s) {
+    amp_timer_set(d, i, last);
+    amp_timer_up(d, i);
+    amp_timer_down(d, last->timer);
+  }
+}
+
+// (re)schedules the selectable to be ticked once wakeup has passed, a
+// wakeup of 0 means it has no deadline
+static void amp_timer_schedule(amp_driver_t *d, amp_selectable_t *s, time_t wakeup)
+{
+  if (!s->tick) return;
+  if (!wakeup) {
+    amp_timer_cancel(d, s);
+    s->wakeup = 0;
+    return;
+  }
+
+  if (s->timer >= 0) {
+    time_t old = s->wakeup;
+    s->wakeup = wakeup;
+    if (wakeup < old)
+      amp_timer_up(d, s->timer);
+    else
+      amp_timer_down(d, s->timer);
+  } else {
+    if (d->timer_count == d->timer_capacity) {
+      d->timer_capacity = d->timer_capacity ? 2*d->timer_capacity : 16;
+      d->timers = realloc(d->timers, d->timer_capacity*sizeof(amp_selectable_t *));
+    }
+    s->wakeup = wakeup;
+    amp_timer_set(d, d->timer_count++, s);
+    amp_timer_up(d, s->timer);
+  }
+}
+
+// milliseconds until the earliest deadline, -1 when nothing is scheduled
+static int amp_timer_timeout(amp_driver_t *d)
+{
+  if (!d->timer_count) return -1;
+  time_t delta = d->timers[0]->wakeup - amp_now();
+  return delta > 0 ? delta : 0;
+}
+
+// the wait timeout for this pass, which is 0 while the spin budget
+// lasts even when there is nothing to wait for but I/O
+static int amp_driver_timeout(amp_driver_t *d)
+{
+  int timeout = amp_timer_timeout(d);
+  d->spinning = false;
+  if (!d->spin_us || !timeout) return timeout;
+  uint64_t now = amp_now_us();
+  if (!d->spin_start) d->spin_start = now;
+  if (now - d->spin_start >= d->spin_us) return timeout;
+  d->spinning = true;
+  return 0;
+}
+
+// the wait timeout for this pass, which also starts the clock on it
+static int amp_driver_wait(amp_driver_t *d)
+{
+  int timeout = amp_driver_timeout(d);
+  d->wait_start = amp_now_ns();
+  return timeout;
+}
+
+static void amp_driver_woke(amp_driver_t *d)
+{
+  AMP_STAT_ADD(d, iterations, 1);
+  AMP_STAT_ADD(d, wait_ns, amp_now_ns() - d->wait_start);
+}
+
+static void amp_driver_handled(amp_driver_t *d, uint64_t start)
+{
+  uint64_t elapsed = amp_now_ns() - start;
+  AMP_STAT_ADD(d, handler_ns, elapsed);
+  if (elapsed > d->stats.handler_max_ns)
+    __atomic_store_n(&d->stats.handler_max_ns, elapsed, __ATOMIC_RELAXED);
+}
+
+// any activity or a proper sleep starts a fresh spin budget
+static void amp_driver_waited(amp_driver_t *d, int n)
+{
+  if (d->spinning) {
+    if (n > 0)
+      AMP_STAT_ADD(d, hits, 1);
+    else
+      AMP_STAT_ADD(d, spins, 1);
+  }
+  if (n || !d->spinning) d->spin_start = 0;
+}
+
+#ifdef AMP_HAVE_EPOLL
+
+static uint32_t amp_sel_epoll_events(int status)
+{
+  return (status & AMP_SEL_RD ? EPOLLIN : 0) |
+    (status & AMP_SEL_WR ? EPOLLOUT : 0) | (status & AMP_SEL_HUP ? EPOLLRDHUP : 0);
+}
+
+// registers the selectable on first use and afterwards only touches
+// the kernel when its interest set has actually changed
+static void amp_epoll_update(amp_driver_t *d, amp_selectable_t *s)
+{
+  if (d->efd == -1 || s->fd == -1 || s->events == s->status) return;
+
+  struct epoll_event ev = {0};
+  ev.events = amp_sel_epoll_events(s->status);
+  ev.data.u64 = s->handle;
+  int op = s->events == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  if (epoll_ctl(d->efd, op, s->fd, &ev) == -1) {
+    perror("epoll_ctl");
+  } else {
+    s->events = s->status;
+  }
+}
+
+#endif
+
+static void amp_driver_update(amp_driver_t *d, amp_selectable_t *s)
+{
+  struct pollfd *fd = &d->fds[1 + (uint32_t) s->handle];
+  fd->fd = s->fd;
+  fd->events = (s->status & AMP_SEL_RD ? POLLIN : 0) |
+    (s->status & AMP_SEL_WR ? POLLOUT : 0) | (s->status & AMP_SEL_HUP ? POLLRDHUP : 0);
+#ifdef AMP_HAVE_URING
+  if (d->uring) amp_uring_update(d->uring, s);
+#endif
+#ifdef AMP_HAVE_EPOLL
+  amp_epoll_update(d, s);
+#endif
+}
+
+// queues the selectable for having its interest passed on to the
+// backend before the next wait, handlers change it freely until then
+static void amp_driver_changed(amp_driver_t *d, amp_selectable_t *s)
+{
+  if (s->changed || s->driver != d) return;
+  LL_ADD_PFX(d->changed_head, d->changed_tail, s, changed_);
+  s->changed = true;
+}
+
+// only what changed since the last wait gets looked at, so idle
+// selectables cost nothing per pass
+static void amp_driver_apply(amp_driver_t *d)
+{
+  while (d->changed_head) {
+    amp_selectable_t *s = d->changed_head;
+    LL_POP_PFX(d->changed_head, d->changed_tail, changed_);
+    s->changed = false;
+    amp_driver_update(d, s);
+  }
+}
+
+// the selectable behind a handle, or NULL when it has gone since
+static amp_selectable_t *amp_driver_lookup(amp_driver_t *d, uint64_t handle)
+{
+  uint32_t i = (uint32_t) handle;
+  if (i >= d->slot_count) return NULL;
+  struct amp_slot *slot = &d->slots[i];
+  return slot->generation == handle >> 32 ? slot->selectable : NULL;
+}
+
+static int amp_driver_add(amp_driver_t *d, amp_selectable_t *s)
+{
+  uint32_t i = d->free_slot;
+  if (i != NO_SLOT) {
+    d->free_slot = d->slots[i].next_free;
+  } else {
+    if (d->slot_count == d->slot_capacity) {
+      uint32_t capacity = d->slot_capacity ? 2*d->slot_capacity : 16;
+      struct amp_slot *slots = realloc(d->slots, capacity*sizeof(struct amp_slot));
+      if (!slots) return -1;
+      d->slots = slots;
+      struct pollfd *fds = realloc(d->fds, (1 + capacity)*sizeof(struct pollfd));
+      if (!fds) return -1;
+      d->fds = fds;
+      d->slot_capacity = capacity;
+    }
+    i = d->slot_count++;
+    d->slots[i].generation = 0;
+  }
+  d->slots[i].selectable = s;
+  s->handle = (uint64_t) d->slots[i].generation << 32 | i;
+  d->fds[1 + i].revents = 0;
+  s->driver = d;
+  d->size++;
+  amp_driver_update(d, s);
+  amp_timer_schedule(d, s, d->now);
+  return 0;
+}
+
+// drops whatever interest the kernel holds for the selectable's fd
+static void amp_driver_unregister(amp_driver_t *d, amp_selectable_t *s)
+{
+#ifdef AMP_HAVE_EPOLL
+  if (d->efd != -1 && s->events != -1) {
+    struct epoll_event ev = {0};
+    epoll_ctl(d->efd, EPOLL_CTL_DEL, s->fd, &ev);
+  }
+#endif
+#ifdef AMP_HAVE_URING
+  if (d->uring) amp_uring_release(d->uring, s);
+#endif
+  s->events = -1;
+}
+
+static void amp_driver_remove(amp_driver_t *d, amp_selectable_t *s)
+{
+  amp_driver_unregister(d, s);
+  amp_timer_cancel(d, s);
+  if (s->flushing) {
+    LL_REMOVE_PFX(d->flush_head, d->flush_tail, s, flush_);
+    s->flushing = false;
+  }
+  if (s->changed) {
+    LL_REMOVE_PFX(d->changed_head, d->changed_tail, s, changed_);
+    s->changed = false;
+  }
+  if (s->draining) {
+    if (s->drained)
+      AMP_STAT_ADD(d, drained, 1);
+    else
+      AMP_STAT_ADD(d, abandoned, 1);
+    s->draining = false;
+  }
+  // the slot is up for reuse straight away, anything still holding the
+  // old handle finds a different generation there
+  uint32_t i = (uint32_t) s->handle;
+  d->slots[i].selectable = NULL;
+  d->slots[i].generation++;
+  d->slots[i].next_free = d->free_slot;
+  d->free_slot = i;
+  d->fds[1 + i].fd = -1;
+  d->fds[1 + i].revents = 0;
+  s->driver = NULL;
+  d->size--;
+}
+
+// detaches the selectable from the driver right away but keeps its
+// memory around until the end of the current pass, so handlers may
+// close selectables while the driver is still walking them
+static void amp_driver_bury(amp_driver_t *d, amp_selectable_t *s)
+{
+  amp_driver_remove(d, s);
+  s->dead_next = d->dead;
+  d->dead = s;
+}
+
+static void amp_driver_drain_ctrl(amp_driver_t *d)
+{
+#ifdef AMP_HAVE_EVENTFD
+  uint64_t count;
+  read(d->ctrl[0], &count, sizeof(count));
+#else
+  char buffer[512];
+  while (read(d->ctrl[0], buffer, 512) == 512);
+#endif
+  // only allow new wakeups once the pending ones are consumed, so a
+  // producer that finds the flag still set knows the pops below are
+  // yet to run
+  __atomic_store_n(&d->woken, false, __ATOMIC_SEQ_CST);
+
+  amp_command_t *cmd;
+  while ((cmd = amp_driver_pop(d))) {
+    uint64_t start = amp_now_ns();
+    bool owned = !cmd->drop;
+    cmd->run(d, cmd->arg);
+    amp_driver_handled(d, start);
+    AMP_STAT_ADD(d, commands, 1);
+    if (owned) free(cmd);
+  }
+}
+
+// ticks every selectable whose deadline has passed and reschedules it
+// for whatever deadline its tick handler asks for
+static void amp_driver_tick(amp_driver_t *d)
+{
+  d->now = amp_now();
+  while (d->timer_count && d->timers[0]->wakeup <= d->now)
+  {
+    amp_selectable_t *s = d->timers[0];
+    amp_timer_cancel(d, s);
+    s->wakeup = 0;
+    uint64_t start = amp_now_ns();
+    time_t wakeup = s->tick(s, d->now);
+    s->woken = false;
+    amp_driver_changed(d, s);
+    amp_driver_handled(d, start);
+    if (s->driver && wakeup) {
+      // don't spin within a single pass
+      if (wakeup <= d->now) wakeup = d->now + 1;
+      amp_timer_schedule(d, s, wakeup);
+    }
+  }
+}
+
+// the selectable's writable handler gets called once all ticks of this
+// pass are done, however often it is deferred until then
+static void amp_driver_defer(amp_driver_t *d, amp_selectable_t *s)
+{
+  if (s->flushing) return;
+  LL_ADD_PFX(d->flush_head, d->flush_tail, s, flush_);
+  s->flushing = true;
+}
+
+static void amp_driver_flush(amp_driver_t *d)
+{
+  while (d->flush_head) {
+    amp_selectable_t *s = d->flush_head;
+    LL_POP_PFX(d->flush_head, d->flush_tail, flush_);
+    s->flushing = false;
+    if (s->writable) {
+      uint64_t start = amp_now_ns();
+      s->writable(s);
+      amp_driver_handled(d, start);
+      amp_driver_changed(d, s);
+    }
+  }
+}
+
+// a hangup or error is for the read handler to find out about whenever
+// the selectable is reading or waiting for the peer to hang up
+static bool amp_sel_readable(amp_selectable_t *s, bool in, bool hup)
+{
+  return (in && s->status & AMP_SEL_RD) || (hup && s->status & (AMP_SEL_RD | AMP_SEL_HUP));
+}
+
+// runs the handlers for whatever readiness the backend reported, I/O
+// activity then makes the selectable due for a tick on the next pass
+static void amp_driver_dispatch(amp_driver_t *d, amp_selectable_t *s,
+                                bool readable, bool writable)
+{
+  uint64_t start = amp_now_ns();
+  if (readable) {
+    s->stats.readable++;
+    s->readable(s);
+  }
+  if (writable && s->driver && s->writable) {
+    s->stats.writable++;
+    s->writable(s);
+  }
+  amp_driver_handled(d, start);
+  if (s->driver) {
+    amp_driver_changed(d, s);
+    amp_timer_schedule(d, s, d->now);
+  }
+}
+
+// the pollfd array lives alongside the registry and is kept up to date
+// by amp_driver_update, vacant slots are left in with an fd of -1
+static void amp_driver_run_poll(amp_driver_t *d)
+{
+  while (!amp_driver_stopping(d))
+  {
+    amp_driver_tick(d);
+    amp_driver_flush(d);
+    amp_driver_reap(d);
+
+    if (d->size == 0) break;
+
+    amp_driver_apply(d);
+    uint32_t n = d->slot_count;
+    struct pollfd *fds = d->fds;
+    fds[0].fd = d->ctrl[0];
+    fds[0].events = POLLIN;
+
+    int result = poll(fds, 1 + n, amp_driver_wait(d));
+    amp_driver_woke(d);
+    amp_driver_waited(d, result);
+    if (result == -1 && errno == EINTR) continue;
+    DIE_IFE(result);
+
+    // handlers may add selectables and so move the array, and may close
+    // them and so clear the revents of their slots
+    for (uint32_t i = 0; i < n && result > 0; i++)
+    {
+      short revents = d->fds[1 + i].revents;
+      if (!revents) continue;
+      result--;
+      d->fds[1 + i].revents = 0;
+      amp_selectable_t *s = d->slots[i].selectable;
+      if (s)
+        amp_driver_dispatch(d, s,
+                            amp_sel_readable(s, revents & POLLIN,
+                                             revents & (POLLHUP | POLLERR | POLLRDHUP)),
+                            revents & (POLLOUT | POLLERR));
+    }
+
+    if (d->fds[0].revents & POLLIN) {
+      //clear the pipe
+      amp_driver_drain_ctrl(d);
+    }
+
+    amp_driver_reap(d);
+  }
+}
+
+#ifdef AMP_HAVE_EPOLL
+
+#define MAX_EVENTS (256)
+
+static void amp_driver_run_epoll(amp_driver_t *d)
+{
+  struct epoll_event events[MAX_EVENTS];
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.u64 = CTRL_HANDLE;
+  DIE_IFE(epoll_ctl(d->efd, EPOLL_CTL_ADD, d->ctrl[0], &ev));
+
+  while (!amp_driver_stopping(d))
+  {
+    amp_driver_tick(d);
+    amp_driver_flush(d);
+    amp_driver_reap(d);
+
+    if (d->size == 0) break;
+
+    amp_driver_apply(d);
+
+    int n = epoll_wait(d->efd, events, MAX_EVENTS, amp_driver_wait(d));
+    amp_driver_woke(d);
+    amp_driver_waited(d, n);
+    if (n == -1 && errno == EINTR) continue;
+    DIE_IFE(n);
+
+    for (int i = 0; i < n; i++)
+    {
+      uint32_t revents = events[i].events;
+      if (events[i].data.u64 == CTRL_HANDLE) {
+        //clear the pipe
+        amp_driver_drain_ctrl(d);
+        continue;
+      }
+      // an earlier handler of this batch may have closed it
+      amp_selectable_t *s = amp_driver_lookup(d, events[i].data.u64);
+      if (!s) continue;
+      amp_driver_dispatch(d, s,
+                          amp_sel_readable(s, revents & EPOLLIN,
+                                           revents & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)),
+                          revents & (EPOLLOUT | EPOLLERR));
+    }
+
+    amp_driver_reap(d);
+  }
+
+  epoll_ctl(d->efd, EPOLL_CTL_DEL, d->ctrl[0], &ev);
+}
+
+#endif
+
+#ifdef AMP_HAVE_URING
+
+// runs the handler for a completion of the selectable's, which with
+// ring owned I/O is the read or write itself rather than readiness
+static void amp_uring_dispatch(amp_driver_t *d, amp_selectable_t *s, int op, int res,
+                               char *bytes)
+{
+  if (op == IORING_OP_POLL_ADD) {
+    int revents = res < 0 ? POLLERR : res;
+    amp_driver_dispatch(d, s,
+                        amp_sel_readable(s, revents & POLLIN,
+                                         revents & (POLLHUP | POLLERR | POLLRDHUP)),
+                        revents & (POLLOUT | POLLERR));
+    return;
+  }
+
+  uint64_t start = amp_now_ns();
+  switch (op) {
+  case IORING_OP_ACCEPT:
+    if (res >= 0)
+      s->accepted(s, res);
+    else if (res != -ECANCELED && res != -ECONNABORTED && res != -EINTR)
+      fprintf(stderr, "accept: %s\n", strerror(-res));
+    break;
+  case IORING_OP_RECV:
+    s->stats.readable++;
+    // out of buffers, the recv goes back in once it is rearmed
+    if (res != -ENOBUFS && res != -ECANCELED)
+      s->received(s, bytes, res);
+    break;
+  case IORING_OP_SENDMSG:
+    s->stats.writable++;
+    s->sent(s, res);
+    break;
+  }
+  amp_driver_handled(d, start);
+  if (s->driver) {
+    amp_driver_changed(d, s);
+    amp_timer_schedule(d, s, d->now);
+  }
+}
+
+// returns how many completions it handled
+static int amp_uring_complete(amp_driver_t *d)
+{
+  amp_uring_t *u = d->uring;
+  unsigned head = *u->cq_head;
+  int count = 0;
+  while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+  {
+    struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+    uint64_t data = cqe->user_data;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    // hand the slot back before running handlers, they may submit
+    __atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+
+    if (data == URING_IGNORE) continue;
+    count++;
+    if (data == URING_CTRL) {
+      u->ctrl_armed = false;
+      amp_driver_drain_ctrl(d);
+      continue;
+    }
+
+    amp_uring_req_t *req = (amp_uring_req_t *) (uintptr_t) data;
+    amp_selectable_t *s = req->selectable;
+    int op = req->op;
+    if (!(flags & IORING_CQE_F_MORE)) {
+      if (s && s->req == req) s->req = NULL;
+      if (s && s->recv == req) s->recv = NULL;
+      if (s && s->send == req) s->send = NULL;
+      LL_REMOVE(u->head, u->tail, req);
+      free(req);
+    }
+
+    unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    char *bytes = flags & IORING_CQE_F_BUFFER ? u->buffers + (size_t) bid*URING_BUF_SIZE : NULL;
+    if (s) amp_uring_dispatch(d, s, op, res, bytes);
+    if (bytes) amp_uring_buf_return(u, bid);
+  }
+  return count;
+}
+
+static void amp_driver_run_uring(amp_driver_t *d)
+{
+  amp_uring_t *u = d->uring;
+
+  while (!amp_driver_stopping(d))
+  {
+    amp_driver_tick(d);
+    amp_driver_flush(d);
+    amp_driver_reap(d);
+
+    if (d->size == 0) break;
+
+    amp_driver_apply(d);
+    if (!u->ctrl_armed) {
+      amp_uring_poll(u, d->ctrl[0], AMP_SEL_RD, URING_CTRL);
+      u->ctrl_armed = true;
+    }
+
+    // a spin only needs a syscall when there is something to submit,
+    // completions can be picked straight off the ring
+    int timeout = amp_driver_wait(d);
+    if (timeout || u->queued) {
+      int n = amp_uring_enter(u, timeout != 0, timeout);
+      if (n == -1 && errno != ETIME && errno != EINTR && errno != EBUSY)
+        DIE_IFE(n);
+    }
+    amp_driver_woke(d);
+
+    amp_driver_waited(d, amp_uring_complete(d));
+    amp_driver_reap(d);
+  }
+}
+
+#endif
+
+void amp_driver_run(amp_driver_t *d)
+{
+#ifdef AMP_HAVE_URING
+  if (d->uring)
+    amp_driver_run_uring(d);
+  else
+#endif
+#ifdef AMP_HAVE_EPOLL
+  if (d->efd != -1)
+    amp_driver_run_epoll(d);
+  else
+#endif
+    amp_driver_run_poll(d);
+}
+
+void amp_driver_stop(amp_driver_t *d)
+{
+  __atomic_store_n(&d->stopping, true, __ATOMIC_SEQ_CST);
+  amp_driver_wake(d);
+}
+
+// anything that does not want to be waited for is gone once this
+// returns, the loop then ends by itself once the rest are
+static void amp_driver_drain_start(amp_driver_t *d, void *arg)
+{
+  if (d->draining) return;
+  d->draining = true;
+  d->drain_deadline = d->now + (intptr_t) arg;
+  for (uint32_t i = 0; i < d->slot_count; i++) {
+    amp_selectable_t *s = d->slots[i].selectable;
+    if (s && s->drain && s->drain(s) && s->driver) {
+      s->draining = true;
+      amp_timer_schedule(d, s, d->now);
+    }
+  }
+}
+
+int amp_driver_drain(amp_driver_t *d, int timeout)
+{
+  return amp_driver_post(d, amp_driver_drain_start, (void *) (intptr_t) timeout);
+}
+
+// pool
+
+amp_pool_t *amp_pool(size_t size)
+{
+  if (!size) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    size = n > 0 ? n : 1;
+  }
+
+  amp_pool_t *p = malloc(sizeof(amp_pool_t));
+  if (!p) return NULL;
+  p->size = 0;
+  p->drivers = malloc(size*sizeof(amp_driver_t *));
+  p->threads = malloc(size*sizeof(pthread_t));
+  if (!p->drivers || !p->threads) {
+    amp_pool_destroy(p);
+    return NULL;
+  }
+  for (size_t i = 0; i < size; i++) {
+    amp_driver_t *d = amp_driver();
+    if (!d) {
+      amp_pool_destroy(p);
+      return NULL;
+    }
+    d->reuseport = true;
+    p->drivers[p->size++] = d;
+  }
+  return p;
+}
+
+size_t amp_pool_size(amp_pool_t *p)
+{
+  return p->size;
+}
+
+amp_driver_t *amp_pool_driver(amp_pool_t *p, size_t index)
+{
+  return index < p->size ? p->drivers[index] : NULL;
+}
+
+static void *amp_pool_thread(void *arg)
+{
+  amp_driver_run(arg);
+  return NULL;
+}
+
+void amp_pool_run(amp_pool_t *p)
+{
+  for (size_t i = 0; i < p->size; i++)
+    DIE_IFR(pthread_create(&p->threads[i], NULL, amp_pool_thread, p->drivers[i]),
+            strerror);
+  for (size_t i = 0; i < p->size; i++)
+    DIE_IFR(pthread_join(p->threads[i], NULL), strerror);
+}
+
+void amp_pool_stop(amp_pool_t *p)
+{
+  for (size_t i = 0; i < p->size; i++)
+    amp_driver_stop(p->drivers[i]);
+}
+
+void amp_pool_drain(amp_pool_t *p, int timeout)
+{
+  for (size_t i = 0; i < p->size; i++)
+    amp_driver_drain(p->drivers[i], timeout);
+}
+
+void amp_pool_destroy(amp_pool_t *p)
+{
+  for (size_t i = 0; i < p->size; i++)
+    amp_driver_destroy(p->drivers[i]);
+  free(p->drivers);
+  free(p->threads);
+  free(p);
+}
+
+static amp_selectable_t *amp_selectable()
+{
+  amp_selectable_t *s = malloc(sizeof(amp_selectable_t));
+  if (!s) return NULL;
+  s->driver = NULL;
+  s->handle = 0;
+  s->dead_next = NULL;
+  s->flush_next = NULL;
+  s->flush_prev = NULL;
+  s->flushing = false;
+  s->changed_next = NULL;
+  s->changed_prev = NULL;
+  s->changed = false;
+  s->status = 0;
+  s->events = -1;
+  s->req = NULL;
+  s->ring = false;
+  s->recv = NULL;
+  s->send = NULL;
+  s->wakeup = 0;
+  s->timer = -1;
+  s->woken = false;
+  s->draining = false;
+  s->drained = false;
+  s->readable = NULL;
+  s->writable = NULL;
+  s->tick = NULL;
+  s->drain = NULL;
+  s->destroy = NULL;
+  s->received = NULL;
+  s->sent = NULL;
+  s->accepted = NULL;
+  memset(&s->stats, 0, sizeof(s->stats));
+  s->context = NULL;
+  return s;
+}
+
+amp_selectable_stats_t amp_selectable_stats(amp_selectable_t *s)
+{
+  return s->stats;
+}
+
+void amp_selectable_wakeup(amp_selectable_t *s)
+{
+  if (s->driver) {
+    s->woken = true;
+    amp_timer_schedule(s->driver, s, s->driver->now);
+  }
+}
+
+void amp_selectable_destroy(amp_selectable_t *s)
+{
+  if (s->driver) amp_driver_remove(s->driver, s);
+  if (s->destroy) s->destroy(s);
+  free(s);
+}
+
+// swaps in another fd, -1 for none, the old one is left for the
+// caller to close
+static void amp_selectable_set_fd(amp_selectable_t *s, int fd)
+{
+  if (s->driver) amp_driver_unregister(s->driver, s);
+  s->fd = fd;
+  if (s->driver) amp_driver_changed(s->driver, s);
+}
+
+// engine related
+
+#define IO_BUF_SIZE (4*1024)
+#define IO_IDLE_SHRINK (5*1000)
+#define IO_VECS (2)//the transport's output is at most two segments
+#define AMQP_PROTO "AMQP\x00\x01\x00\x00"
+#define AMQP_PROTO_SIZE (8)
+
+struct amp_engine_ctx {
+  amp_connection_t *connection;
+  amp_transport_t *transport;
+  char *input;
+  size_t in_head;//start of unconsumed input
+  size_t in_size;//unconsumed input
+  size_t in_capacity;
+  time_t last_read;
+  int proto_size;//unsent bytes of our protocol header
+  bool header;//the peer's protocol header is in
+  bool connecting;
+  bool paused;//read interest dropped while too much is buffered
+  struct amp_addr *addrs;//addresses to try while connecting
+  size_t addr_count;
+  size_t addr_next;
+  struct amp_connect_job *resolving;//lookup in flight, if any
+  void (*callback)(amp_connection_t*, void*);
+  void *context;
+};
+
+struct amp_connect_job {
+  amp_job_t job;
+  amp_command_t command;//brings the outcome back to the loop thread
+  amp_selectable_t *selectable;//NULL once the connector is gone
+  struct addrinfo *result;
+  int code;
+  char *port;
+  char host[];
+};
+
+static void amp_selectable_engine_close(amp_selectable_t *sel)
+{
+  sel->status = 0;
+  amp_driver_bury(sel->driver, sel);
+  if (sel->fd != -1 && close(sel->fd) == -1)
+    perror("close");
+}
+
+static bool amp_would_block()
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// per socket tuning the driver asks for
+static void amp_sock_options(amp_driver_t *d, int sock)
+{
+  // frames go out as soon as we write them, batching them up is what
+  // coalescing is for, fails harmlessly on unix sockets
+  int nodelay = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+#ifdef SO_BUSY_POLL
+  if (d->busy_poll_us) {
+    int usecs = d->busy_poll_us;
+    // raising it past net.core.busy_read needs CAP_NET_ADMIN, without
+    // that we just go on with the spinning the loop does itself
+    setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+  }
+#endif
+}
+
+static int amp_sock_nonblock(int sock)
+{
+  int flags = fcntl(sock, F_GETFL);
+  if (flags == -1) return -1;
+  return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+// makes room at the end of the input buffer, consumed frames are only
+// skipped over so the trailing partial frame gets moved to the front
+// once we run out of space, and when even that doesn't help the
+// partial frame is bigger than the buffer and we grow it up to the
+// largest frame the transport accepts
+static bool amp_selectable_engine_reserve(struct amp_engine_ctx *ctx)
+{
+  if (ctx->in_head + ctx->in_size < ctx->in_capacity) return true;
+
+  if (ctx->in_head) {
+    memmove(ctx->input, ctx->input + ctx->in_head, ctx->in_size);
+    ctx->in_head = 0;
+    return true;
+  }
+
+  size_t max = amp_get_max_frame(ctx->transport);
+  if (ctx->in_capacity >= max) return false;
+  size_t capacity = 2*ctx->in_capacity < max ? 2*ctx->in_capacity : max;
+  char *input = realloc(ctx->input, capacity);
+  if (!input) return false;
+  ctx->input = input;
+  ctx->in_capacity = capacity;
+  return true;
+}
+
+// gives back the memory of a grown input buffer once the connection
+// has been idle for a while
+static time_t amp_selectable_engine_shrink(struct amp_engine_ctx *ctx, time_t now)
+{
+  if (ctx->in_size || ctx->in_capacity <= IO_BUF_SIZE) return 0;
+
+  if (now - ctx->last_read < IO_IDLE_SHRINK)
+    return ctx->last_read + IO_IDLE_SHRINK;
+
+  char *input = realloc(ctx->input, IO_BUF_SIZE);
+  if (input) {
+    ctx->input = input;
+    ctx->in_capacity = IO_BUF_SIZE;
+    ctx->in_head = 0;
+  }
+  return 0;
+}
+
+// reads until the socket would block or the input buffer is full
+static struct amp_engine_ctx *amp_selectable_engine_read(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  if (!amp_selectable_engine_reserve(ctx)) {
+    printf("frame too large: %zu\n", ctx->in_size);
+    amp_selectable_engine_close(sel);
+    return NULL;
+  }
+
+  ctx->last_read = sel->driver->now;
+  size_t end;
+  while ((end = ctx->in_head + ctx->in_size) < ctx->in_capacity) {
+    ssize_t n = recv(sel->fd, ctx->input + end, ctx->in_capacity - end, 0);
+    sel->stats.recv_calls++;
+    if (n > 0) {
+      ctx->in_size += n;
+      sel->stats.bytes_read += n;
+      AMP_STAT_MAX(sel, input_high, ctx->in_size);
+    } else if (n < 0 && amp_would_block()) {
+      sel->stats.eagain++;
+      break;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      printf("disconnected: %zi\n", n);
+      amp_selectable_engine_close(sel);
+      return NULL;
+    }
+  }
+  return ctx;
+}
+
+static void amp_selectable_engine_consume(struct amp_engine_ctx *ctx, int n)
+{
+  ctx->in_size -= n;
+  ctx->in_head = ctx->in_size ? ctx->in_head + n : 0;
+}
+
+// stops reading while the connection holds more than the high
+// watermark and picks up again once it is down to the low one
+static void amp_engine_pressure(amp_selectable_t *sel, struct amp_engine_ctx *ctx)
+{
+  amp_driver_t *d = sel->driver;
+  if (!d || ctx->connecting) return;
+  size_t buffered = amp_buffered(ctx->transport);
+  if (!ctx->paused && d->high_water && buffered > d->high_water) {
+    ctx->paused = true;
+    sel->status &= ~AMP_SEL_RD;
+  } else if (ctx->paused && (!d->high_water || buffered <= d->low_water)) {
+    ctx->paused = false;
+    sel->status |= AMP_SEL_RD;
+  }
+}
+
+static void amp_engine_readable_input(amp_selectable_t *sel, struct amp_engine_ctx *ctx)
+{
+  amp_transport_t *transport = ctx->transport;
+  ssize_t n = amp_input(transport, ctx->input + ctx->in_head, ctx->in_size);
+  if (n < 0) {
+    if (n != EOS) {
+      printf("error: %zi\n", n);
+    }
+    amp_selectable_engine_close(sel);
+  } else {
+    amp_selectable_engine_consume(ctx, n);
+    amp_engine_pressure(sel, ctx);
+  }
+}
+
+// the peer's protocol header comes ahead of its first frame
+static void amp_engine_input(amp_selectable_t *sel, struct amp_engine_ctx *ctx)
+{
+  if (!ctx->header) {
+    if (ctx->in_size < AMQP_PROTO_SIZE) return;
+    if (memcmp(ctx->input + ctx->in_head, AMQP_PROTO, AMQP_PROTO_SIZE)) {
+      printf("header missmatch");
+      amp_selectable_engine_close(sel);
+      return;
+    }
+    amp_selectable_engine_consume(ctx, AMQP_PROTO_SIZE);
+    ctx->header = true;
+  }
+  amp_engine_readable_input(sel, ctx);
+}
+
+static void amp_engine_readable(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = amp_selectable_engine_read(sel);
+  if (ctx) amp_engine_input(sel, ctx);
+}
+
+// points iov at our protocol header, for as long as it is not all
+// out, and then at all of the transport's output, returning how many
+// it filled in or -1 once the selectable is closed
+static int amp_engine_output(amp_selectable_t *sel, struct amp_engine_ctx *ctx,
+                             struct iovec *iov)
+{
+  int count = 0;
+  if (ctx->proto_size) {
+    iov[0].iov_base = AMQP_PROTO + AMQP_PROTO_SIZE - ctx->proto_size;
+    iov[0].iov_len = ctx->proto_size;
+    count++;
+  }
+
+  int n = amp_output_iov(ctx->transport, iov + count, IO_VECS);
+  if (n < 0) {
+    // EOS means the transport has given up, on an idle peer say
+    if (n != EOS) printf("internal error: %i", n);
+    amp_selectable_engine_close(sel);
+    return -1;
+  }
+  count += n;
+
+  size_t pending = 0;
+  for (int i = 0; i < count; i++) pending += iov[i].iov_len;
+  AMP_STAT_MAX(sel, output_high, pending);
+  return count;
+}
+
+static void amp_engine_output_consume(amp_selectable_t *sel, struct amp_engine_ctx *ctx,
+                                      size_t sent)
+{
+  sel->stats.bytes_written += sent;
+  if (ctx->proto_size) {
+    size_t proto = sent < ctx->proto_size ? sent : ctx->proto_size;
+    ctx->proto_size -= proto;
+    sent -= proto;
+  }
+  amp_output_consume(ctx->transport, sent);
+}
+
+// blocked is whether output is still waiting to go out
+static void amp_engine_output_done(amp_selectable_t *sel, struct amp_engine_ctx *ctx,
+                                   bool blocked)
+{
+  if (blocked)
+    sel->status |= AMP_SEL_WR;
+  else
+    sel->status &= ~AMP_SEL_WR;
+  amp_engine_pressure(sel, ctx);
+  if (sel->draining) {
+    // our CLOSE is out along with everything before it, the peer still
+    // gets to answer with its own unless it has already
+    sel->drained = !blocked;
+    if (sel->drained && amp_remote_state((amp_endpoint_t *) ctx->connection) == CLOSED)
+      amp_selectable_engine_close(sel);
+  }
+}
+
+#ifdef AMP_HAVE_URING
+
+// with the ring doing the writing a connection has a single sendmsg in
+// flight, the output that piles up meanwhile goes with the next one,
+// which is made from the completion, so there is nothing to link
+static void amp_engine_send(amp_selectable_t *sel, struct amp_engine_ctx *ctx)
+{
+  struct iovec iov[1 + IO_VECS];
+  // gathering the output also processes the transport, so it is done
+  // even while a send is in flight
+  int count = amp_engine_output(sel, ctx, iov);
+  if (count < 0) return;
+  if (count && !sel->send && amp_uring_send(sel->driver->uring, sel, iov, count)) {
+    perror("writable");
+    amp_selectable_engine_close(sel);
+    return;
+  }
+  amp_engine_output_done(sel, ctx, count > 0);
+}
+
+static void amp_engine_sent(amp_selectable_t *sel, ssize_t n)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  if (n < 0) {
+    fprintf(stderr, "writable: %s\n", strerror(-n));
+    amp_selectable_engine_close(sel);
+    return;
+  }
+  amp_engine_output_consume(sel, ctx, n);
+  amp_engine_send(sel, ctx);
+}
+
+// input the ring has read for us, copied out of its buffer so that it
+// can go back to the kernel straight away
+static void amp_engine_received(amp_selectable_t *sel, char *bytes, ssize_t n)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  if (n <= 0) {
+    printf("disconnected: %zi\n", n);
+    amp_selectable_engine_close(sel);
+    return;
+  }
+
+  ctx->last_read = sel->driver->now;
+  sel->stats.bytes_read += n;
+  while (n && sel->driver) {
+    if (!amp_selectable_engine_reserve(ctx)) {
+      printf("frame too large: %zu\n", ctx->in_size);
+      amp_selectable_engine_close(sel);
+      return;
+    }
+    size_t end = ctx->in_head + ctx->in_size;
+    size_t size = ctx->in_capacity - end < n ? ctx->in_capacity - end : n;
+    memcpy(ctx->input + end, bytes, size);
+    ctx->in_size += size;
+    bytes += size;
+    n -= size;
+    AMP_STAT_MAX(sel, input_high, ctx->in_size);
+    amp_engine_input(sel, ctx);
+  }
+}
+
+#endif
+
+// writes straight out of the transport's buffers until it has nothing
+// more to say or the socket would block, in which case we keep write
+// interest until it drains
+static void amp_engine_writable(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+#ifdef AMP_HAVE_URING
+  if (sel->ring) {
+    amp_engine_send(sel, ctx);
+    return;
+  }
+#endif
+  bool blocked = false;
+  while (true) {
+    struct iovec iov[1 + IO_VECS];
+    int count = amp_engine_output(sel, ctx, iov);
+    if (count < 0) return;
+    if (!count) break;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t sent = sendmsg(sel->fd, &msg, MSG_NOSIGNAL);
+    sel->stats.send_calls++;
+    if (sent < 0) {
+      if (amp_would_block()) {
+        sel->stats.eagain++;
+        blocked = true;
+        break;
+      }
+      if (errno == EINTR) continue;
+      perror("writable");
+      amp_selectable_engine_close(sel);
+      return;
+    }
+    amp_engine_output_consume(sel, ctx, sent);
+  }
+  amp_engine_output_done(sel, ctx, blocked);
+}
+
+static void amp_engine_connected(amp_selectable_t *sel);
+
+// starts a non blocking connect to the next address on the list, the
+// engine holds off until the socket turns writable
+static void amp_engine_connect_next(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  int error = ENOENT;
+  while (ctx->addr_next < ctx->addr_count) {
+    struct amp_addr *addr = &ctx->addrs[ctx->addr_next++];
+    int sock = socket(addr->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      addr->protocol);
+    if (sock == -1) {
+      error = errno;
+      continue;
+    }
+    if (connect(sock, (struct sockaddr *) &addr->addr, addr->addrlen) == -1 &&
+        errno != EINPROGRESS && errno != EAGAIN) {
+      error = errno;
+      close(sock);
+      continue;
+    }
+    amp_sock_options(sel->driver, sock);
+    amp_selectable_set_fd(sel, sock);
+    sel->writable = &amp_engine_connected;
+    sel->status = AMP_SEL_WR;
+    return;
+  }
+
+  fprintf(stderr, "connect: %s\n", strerror(error));
+  amp_selectable_engine_close(sel);
+}
+
+// takes a copy of the addresses and starts on the first of them,
+// returns NULL if none of them would take, the selectable is closed
+// by then
+static amp_selectable_t *amp_engine_connect(amp_selectable_t *sel, const struct amp_addr *addrs,
+                                            size_t count)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  free(ctx->addrs);
+  ctx->addrs = malloc((count ? count : 1)*sizeof(struct amp_addr));
+  ctx->addr_count = ctx->addrs ? count : 0;
+  ctx->addr_next = 0;
+  if (ctx->addr_count)
+    memcpy(ctx->addrs, addrs, count*sizeof(struct amp_addr));
+  amp_engine_connect_next(sel);
+  return sel->driver ? sel : NULL;
+}
+
+// completes a non blocking connect once the socket turns writable,
+// moving on to the next address if it failed
+static void amp_engine_connected(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(sel->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+    error = errno;
+  if (error) {
+    fprintf(stderr, "connect: %s\n", strerror(error));
+    int fd = sel->fd;
+    amp_selectable_set_fd(sel, -1);
+    close(fd);
+    amp_engine_connect_next(sel);
+    return;
+  }
+
+  ctx->connecting = false;
+  sel->writable = &amp_engine_writable;
+  sel->ring = sel->driver->uring != NULL;
+  sel->status = AMP_SEL_RD | AMP_SEL_WR | AMP_SEL_HUP;
+  amp_engine_writable(sel);
+}
+
+static time_t amp_selectable_engine_tick(amp_selectable_t *sel, time_t now)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  time_t result = amp_tick(ctx->transport, now);
+  time_t shrink = amp_selectable_engine_shrink(ctx, now);
+  if (shrink && (!result || shrink < result)) result = shrink;
+  // idle connections get ticked for their deadlines too, but only the
+  // ones something happened to need the callback and output processing,
+  // an explicitly woken one gets the callback regardless
+  if (amp_connection_dirty(ctx->connection) || sel->woken) {
+    if (ctx->callback) ctx->callback(ctx->connection, ctx->context);
+    amp_connection_clean(ctx->connection);
+    if (!ctx->connecting) {
+      if (sel->driver->coalesce)
+        amp_driver_defer(sel->driver, sel);
+      else
+        amp_engine_writable(sel);
+    }
+  }
+  // the callback may have taken deliveries off a paused connection
+  amp_engine_pressure(sel, ctx);
+  if (sel->draining && sel->driver) {
+    time_t deadline = sel->driver->drain_deadline;
+    if (now >= deadline) {
+      amp_selectable_engine_close(sel);
+      return 0;
+    }
+    if (!result || deadline < result) result = deadline;
+  }
+  return result;
+}
+
+// a connection still being set up has no peer to say goodbye to
+static bool amp_engine_drain(amp_selectable_t *sel)
+{
+  struct amp_engine_ctx *ctx = sel->context;
+  if (ctx->connecting) {
+    amp_selectable_engine_close(sel);
+    return false;
+  }
+  amp_close((amp_endpoint_t *) ctx->connection);
+  sel->woken = true;
+  return true;
+}
+
+// the listening socket is gone already if the acceptor was drained
+static void amp_acceptor_destroy(amp_selectable_t *sel)
+{
+  if (sel->fd != -1 && close(sel->fd) == -1)
+    perror("close");
+  free(sel->context);
+  sel->context = NULL;
+}
+
+static bool amp_acceptor_drain(amp_selectable_t *sel)
+{
+  amp_selectable_engine_close(sel);
+  sel->fd = -1;
+  return false;
+}
+
+static void amp_engine_destroy(amp_selectable_t *s)
+{
+  struct amp_engine_ctx *ctx = s->context;
+  if (ctx) {
+    if (ctx->resolving) ctx->resolving->selectable = NULL;
+    amp_destroy((amp_endpoint_t *)ctx->connection);
+    free(ctx->addrs);
+    free(ctx->input);
+    free(ctx);
+    s->context = NULL;
+  }
+}
+
+static amp_selectable_t *amp_selectable_engine(amp_driver_t *drv, int sock,
+                                               amp_connection_t *conn,
+                                               void (*cb)(amp_connection_t*, void*), void* ctx)
+{
+  amp_selectable_t *sel = amp_selectable();
+  sel->fd = sock;
+  sel->readable = &amp_engine_readable;
+  sel->writable = &amp_engine_writable;
+#ifdef AMP_HAVE_URING
+  sel->received = &amp_engine_received;
+  sel->sent = &amp_engine_sent;
+#endif
+  sel->destroy = &amp_engine_destroy;
+  sel->tick = &amp_selectable_engine_tick;
+  sel->drain = &amp_engine_drain;
+  sel->status = AMP_SEL_RD | AMP_SEL_WR | AMP_SEL_HUP;
+  struct amp_engine_ctx *sctx = malloc(sizeof(struct amp_engine_ctx));
+  sctx->connection = conn;
+  sctx->transport = amp_transport(conn);
+  amp_set_idle_timeout(sctx->transport, drv->idle_timeout);
+  if (drv->trace) {
+    amp_trace_sink(sctx->transport, drv->trace);
+    if (!amp_trace_get(sctx->transport))
+      amp_trace_set(sctx->transport, AMP_TRACE_FRAMES);
+  }
+  sctx->input = malloc(IO_BUF_SIZE);
+  sctx->in_head = 0;
+  sctx->in_size = 0;
+  sctx->in_capacity = IO_BUF_SIZE;
+  sctx->last_read = 0;
+  sctx->connecting = false;
+  sctx->paused = false;
+  sctx->addrs = NULL;
+  sctx->addr_count = 0;
+  sctx->addr_next = 0;
+  sctx->resolving = NULL;
+  sctx->proto_size = AMQP_PROTO_SIZE;
+  sctx->header = false;
+  sctx->callback = cb;
+  sctx->context = ctx;
+  sel->context = sctx;
+  return sel;
+}
+
+// a selectable for a connection that has no socket yet, it only gets
+// one once there is an address to connect to
+static amp_selectable_t *amp_connecting(amp_driver_t *drv,
+                                        void (*cb)(amp_connection_t*, void*), void* ctx)
+{
+  amp_selectable_t *s = amp_selectable_engine(drv, -1, amp_connection(), cb, ctx);
+  struct amp_engine_ctx *sctx = s->context;
+  sctx->connecting = true;
+  s->status = 0;
+  if (amp_driver_add(drv, s)) {
+    amp_selectable_destroy(s);
+    return NULL;
+  }
+  return s;
+}
+
+static struct addrinfo *amp_connect_hints(struct addrinfo *hints)
+{
+  memset(hints, 0, sizeof(*hints));
+  hints->ai_family = AF_UNSPEC;
+  hints->ai_socktype = SOCK_STREAM;
+  hints->ai_flags = AI_ADDRCONFIG;
+  return hints;
+}
+
+// back on the loop thread with the outcome of the lookup
+static void amp_connect_resolved(amp_driver_t *d, void *arg)
+{
+  struct amp_connect_job *job = arg;
+  amp_selectable_t *s = job->selectable;
+  size_t count = 0;
+  struct amp_addr *addrs = job->code ? NULL : amp_addrs(job->result, &count);
+  amp_dns_put(d, job->host, job->port, addrs, count);
+
+  if (s) {
+    struct amp_engine_ctx *ctx = s->context;
+    ctx->resolving = NULL;
+    if (job->code) {
+      fprintf(stderr, "%s:%s: %s\n", job->host, job->port, gai_strerror(job->code));
+      amp_selectable_engine_close(s);
+    } else {
+      amp_engine_connect(s, addrs, count);
+    }
+  }
+
+  free(addrs);
+  if (job->result) freeaddrinfo(job->result);
+  free(job);
+}
+
+// the driver is going away before the outcome of the lookup got back
+static void amp_connect_drop(void *arg)
+{
+  struct amp_connect_job *job = arg;
+  if (job->result) freeaddrinfo(job->result);
+  free(job);
+}
+
+static void amp_connect_job_run(amp_driver_t *d, amp_job_t *j)
+{
+  struct amp_connect_job *job = (struct amp_connect_job *) j;
+  struct addrinfo hints;
+  job->code = getaddrinfo(job->host, job->port, amp_connect_hints(&hints), &job->result);
+  if (job->code) job->result = NULL;
+  // the command is part of the job, so sending it back can't fail
+  job->command.run = amp_connect_resolved;
+  job->command.drop = amp_connect_drop;
+  job->command.arg = job;
+  amp_driver_send(d, &job->command);
+}
+
+// returns straight away, the lookup happens on a resolver thread unless
+// it is still cached from an earlier connect
+amp_selectable_t *amp_connector(amp_driver_t *drv, char *host, char *port,
+                                void (*cb)(amp_connection_t*, void*), void* ctx)
+{
+  amp_selectable_t *s = amp_connecting(drv, cb, ctx);
+  if (!s) return NULL;
+  printf("Connecting to %s:%s\n", host, port);
+
+  amp_dns_entry_t *e = amp_dns_get(drv, host, port);
+  if (e) return amp_engine_connect(s, e->addrs, e->count);
+
+  size_t hostlen = strlen(host) + 1;
+  struct amp_connect_job *job = malloc(sizeof(struct amp_connect_job) + hostlen + strlen(port) + 1);
+  if (!job) {
+    amp_selectable_engine_close(s);
+    return NULL;
+  }
+  job->job.run = amp_connect_job_run;
+  job->selectable = s;
+  job->result = NULL;
+  job->code = 0;
+  job->port = job->host + hostlen;
+  strcpy(job->host, host);
+  strcpy(job->port, port);
+
+  struct amp_engine_ctx *sctx = s->context;
+  sctx->resolving = job;
+  if (amp_resolver_submit(drv, &job->job)) {
+    // no resolver thread to be had, so do it here after all
+    sctx->resolving = NULL;
+    struct addrinfo hints, *result;
+    int code = getaddrinfo(host, port, amp_connect_hints(&hints), &result);
+    if (code) {
+      fprintf(stderr, "%s:%s: %s\n", host, port, gai_strerror(code));
+      amp_selectable_engine_close(s);
+      return NULL;
+    }
+    size_t count;
+    struct amp_addr *addrs = amp_addrs(result, &count);
+    freeaddrinfo(result);
+    amp_dns_put(drv, host, port, addrs, count);
+    s = amp_engine_connect(s, addrs, count);
+    free(addrs);
+  }
+  return s;
+}
+
+amp_selectable_t *amp_connector_addrinfo(amp_driver_t *drv, const struct addrinfo *addrs,
+                                         void (*cb)(amp_connection_t*, void*), void* ctx)
+{
+  size_t count;
+  struct amp_addr *list = amp_addrs(addrs, &count);
+  if (!list) return NULL;
+  amp_selectable_t *s = amp_connecting(drv, cb, ctx);
+  if (s) s = amp_engine_connect(s, list, count);
+  free(list);
+  return s;
+}
+
+// a leading '@' names a socket in the Linux abstract namespace, which
+// has no file behind it and goes away with the last socket bound to it
+static int amp_unix_addr(const char *path, struct sockaddr_un *addr, socklen_t *addrlen)
+{
+  size_t len = strlen(path);
+  if (len + 1 > sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  memcpy(addr->sun_path, path, len);
+  if (path[0] == '@') {
+    addr->sun_path[0] = '\0';
+    *addrlen = offsetof(struct sockaddr_un, sun_path) + len;
+  } else {
+    *addrlen = offsetof(struct sockaddr_un, sun_path) + len + 1;
+  }
+  return 0;
+}
+
+amp_selectable_t *amp_unix_connector(amp_driver_t *drv, char *path,
+                                     void (*cb)(amp_connection_t*, void*), void* ctx)
+{
+  struct amp_addr addr;
+  struct sockaddr_un *sun = (struct sockaddr_un *) &addr.addr;
+  if (amp_unix_addr(path, sun, &addr.addrlen) == -1)
+    return NULL;
+  addr.family = AF_UNIX;
+  addr.protocol = 0;
+
+  amp_selectable_t *s = amp_connecting(drv, cb, ctx);
+  if (!s) return NULL;
+  printf("Connecting to %s\n", path);
+  return amp_engine_connect(s, &addr, 1);
+}
+
+struct amp_name_job {
+  amp_job_t job;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  char peer[NI_MAXHOST + NI_MAXSERV];
+};
+
+static void amp_name_job_run(amp_driver_t *d, amp_job_t *job)
+{
+  struct amp_name_job *nj = (struct amp_name_job *) job;
+  char host[NI_MAXHOST];
+  if (!getnameinfo((struct sockaddr *) &nj->addr, nj->addrlen, host, sizeof(host),
+                   NULL, 0, NI_NAMEREQD))
+    printf("peer %s is %s\n", nj->peer, host);
+  free(nj);
+}
+
+// numeric only, a reverse lookup here would stall the whole loop, so
+// that is left to the resolver threads when the driver asks for it
+static void amp_accepted(amp_selectable_t *s, int sock, struct sockaddr_storage *addr,
+                         socklen_t addrlen)
+{
+  char host[NI_MAXHOST], serv[NI_MAXSERV];
+  char peer[NI_MAXHOST + NI_MAXSERV];
+  int code;
+  if (addr->ss_family == AF_UNIX) {
+    // peers are hardly ever bound to a name of their own
+    snprintf(peer, sizeof(peer), "local peer");
+  } else if ((code = getnameinfo((struct sockaddr *) addr, addrlen, host, sizeof(host),
+                                 serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV))) {
+    printf("getnameinfo: %s\n", gai_strerror(code));
+    if (close(sock) == -1)
+      perror("close");
+    return;
+  } else {
+    snprintf(peer, sizeof(peer), "%s:%s", host, serv);
+    if (s->driver->resolve) {
+      struct amp_name_job *nj = malloc(sizeof(struct amp_name_job));
+      if (nj) {
+        nj->job.run = amp_name_job_run;
+        memcpy(&nj->addr, addr, addrlen);
+        nj->addrlen = addrlen;
+        strcpy(nj->peer, peer);
+        amp_resolver_submit(s->driver, &nj->job);
+      }
+    }
+  }
+
+  printf("accepted from %s\n", peer);
+  amp_sock_options(s->driver, sock);
+  amp_connection_t *conn = amp_connection();
+  struct amp_engine_ctx *ctx = s->context;
+  amp_selectable_t *a = amp_selectable_engine(s->driver, sock, conn, ctx->callback, ctx->context);
+  a->status = AMP_SEL_RD | AMP_SEL_WR | AMP_SEL_HUP;
+  a->ring = s->driver->uring != NULL;
+  if (amp_driver_add(s->driver, a)) {
+    perror("amp_driver_add");
+    amp_selectable_destroy(a);
+    close(sock);
+  }
+}
+
+// drains the whole backlog so a burst of connects costs one wakeup
+static void do_accept(amp_selectable_t *s)
+{
+  while (s->driver) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int sock = accept4(s->fd, (struct sockaddr *) &addr, &addrlen,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (sock == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (!amp_would_block()) perror("accept");
+      return;
+    }
+    amp_accepted(s, sock, &addr, addrlen);
+  }
+}
+
+#ifdef AMP_HAVE_URING
+
+// the ring's multishot accept leaves the peer's address for us to ask
+static void amp_acceptor_accepted(amp_selectable_t *s, int sock)
+{
+  struct sockaddr_storage addr;
+  socklen_t addrlen = sizeof(addr);
+  if (getpeername(sock, (struct sockaddr *) &addr, &addrlen) == -1) {
+    perror("getpeername");
+    close(sock);
+    return;
+  }
+  amp_accepted(s, sock, &addr, addrlen);
+}
+
+#endif
+
+static amp_selectable_t *amp_listen_sock(amp_driver_t *drv, int sock,
+                                         struct sockaddr *addr, socklen_t addrlen,
+                                         void (*cb)(amp_connection_t*, void*), void* context)
+{
+  if (bind(sock, addr, addrlen) == -1 ||
+      amp_sock_nonblock(sock) == -1 ||
+      listen(sock, drv->backlog) == -1) {
+    close(sock);
+    return NULL;
+  }
+
+  amp_selectable_t *s = amp_selectable();
+  s->fd = sock;
+  s->readable = &do_accept;
+  s->writable = NULL;
+  s->drain = &amp_acceptor_drain;
+  s->destroy = &amp_acceptor_destroy;
+#ifdef AMP_HAVE_URING
+  s->accepted = &amp_acceptor_accepted;
+#endif
+  s->ring = drv->uring != NULL;
+  s->status = AMP_SEL_RD;
+  struct amp_engine_ctx *ctx = malloc(sizeof(struct amp_engine_ctx));
+  ctx->callback = cb;
+  ctx->context = context;
+  s->context = ctx;
+
+  if (amp_driver_add(drv, s)) {
+    amp_selectable_destroy(s);
+    close(sock);
+    return NULL;
+  }
+  return s;
+}
+
+amp_selectable_t *amp_acceptor(amp_driver_t *drv, char *host, char *port,
+                               void (*cb)(amp_connection_t*, void*), void* context)
+{
+  struct addrinfo *addr;
+  int code = getaddrinfo(host, port, NULL, &addr);
+  if (code) {
+    fprintf(stderr, "%s", gai_strerror(code));
+    return NULL;
+  }
+
+  int sock = socket(AF_INET, SOCK_STREAM, getprotobyname("tcp")->p_proto);
+  if (sock == -1) {
+    freeaddrinfo(addr);
+    return NULL;
+  }
+
+  int optval = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1 ||
+      // each driver in a pool binds its own listener and the kernel
+      // spreads incoming connections across them
+      (drv->reuseport &&
+       setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1)) {
+    close(sock);
+    freeaddrinfo(addr);
+    return NULL;
+  }
+
+  amp_selectable_t *s = amp_listen_sock(drv, sock, addr->ai_addr, addr->ai_addrlen, cb, context);
+  freeaddrinfo(addr);
+  if (s) printf("Listening on %s:%s\n", host, port);
+  return s;
+}
+
+amp_selectable_t *amp_unix_acceptor(amp_driver_t *drv, char *path,
+                                    void (*cb)(amp_connection_t*, void*), void* context)
+{
+  struct sockaddr_un addr;
+  socklen_t addrlen;
+  if (amp_unix_addr(path, &addr, &addrlen) == -1)
+    return NULL;
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1)
+    return NULL;
+
+  amp_selectable_t *s = amp_listen_sock(drv, sock, (struct sockaddr *) &addr, addrlen, cb, context);
+  if (s) printf("Listening on %s\n", path);
   return s;
 }
+
+// loopback
+
+struct amp_loopback_pipe {
+  amp_transport_t *from;
+  amp_transport_t *to;
+  char *bytes;//output the receiving side has not taken yet
+  size_t size;
+  size_t capacity;
+  bool closed;//the receiving side is gone, whatever is left gets dropped
+};
+
+struct amp_loopback_t {
+  amp_connection_t *connections[2];
+  void (*callbacks[2])(amp_connection_t *, void *);
+  void *contexts[2];
+  struct amp_loopback_pipe pipes[2];
+  size_t frames;
+};
+
+amp_loopback_t *amp_loopback(void (*client)(amp_connection_t*, void*), void *client_context,
+                             void (*server)(amp_connection_t*, void*), void *server_context)
+{
+  amp_loopback_t *l = malloc(sizeof(amp_loopback_t));
+  if (!l) return NULL;
+  l->callbacks[0] = client;
+  l->contexts[0] = client_context;
+  l->callbacks[1] = server;
+  l->contexts[1] = server_context;
+  for (int i = 0; i < 2; i++) {
+    l->connections[i] = amp_connection();
+    l->pipes[i].from = amp_transport(l->connections[i]);
+  }
+  for (int i = 0; i < 2; i++) {
+    struct amp_loopback_pipe *p = &l->pipes[i];
+    p->to = l->pipes[1 - i].from;
+    p->bytes = NULL;
+    p->size = 0;
+    p->capacity = 0;
+    p->closed = false;
+  }
+  l->frames = 0;
+  return l;
+}
+
+// frames in a run of bytes amp_input has just consumed, so it always
+// ends on a frame boundary
+static size_t amp_loopback_count(const char *bytes, size_t n)
+{
+  size_t frames = 0;
+  size_t offset = 0;
+  while (offset + 4 <= n) {
+    const unsigned char *b = (const unsigned char *) bytes + offset;
+    uint32_t size = (uint32_t) b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+    if (!size) break;
+    offset += size;
+    frames++;
+  }
+  return frames;
+}
+
+static size_t amp_loopback_input(amp_loopback_t *l, struct amp_loopback_pipe *p,
+                                 char *bytes, size_t n)
+{
+  ssize_t c = amp_input(p->to, bytes, n);
+  if (c < 0) {
+    p->closed = true;
+    p->size = 0;
+    return 0;
+  }
+  l->frames += amp_loopback_count(bytes, c);
+  return c;
+}
+
+// hands the pending output straight to the other side and only copies
+// what it could not take in one go, returns how many bytes moved
+static size_t amp_loopback_pipe_pump(amp_loopback_t *l, struct amp_loopback_pipe *p)
+{
+  struct iovec iov[IO_VECS];
+  size_t moved = 0;
+  size_t taken = 0;
+  int n = amp_output_iov(p->from, iov, IO_VECS);
+  for (int i = 0; i < n; i++) {
+    char *bytes = iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+    taken += len;
+    if (!p->size && !p->closed) {
+      size_t c = amp_loopback_input(l, p, bytes, len);
+      bytes += c;
+      len -= c;
+    }
+    if (len && !p->closed && p->size + len > p->capacity) {
+      size_t capacity = p->capacity ? p->capacity : IO_BUF_SIZE;
+      while (capacity < p->size + len) capacity *= 2;
+      char *grown = realloc(p->bytes, capacity);
+      if (grown) {
+        p->bytes = grown;
+        p->capacity = capacity;
+      } else {
+        perror("loopback");
+        p->closed = true;
+        p->size = 0;
+      }
+    }
+    if (len && !p->closed) {
+      memcpy(p->bytes + p->size, bytes, len);
+      p->size += len;
+    }
+  }
+  if (taken) amp_output_consume(p->from, taken);
+  moved += taken;
+
+  if (p->size) {
+    size_t c = amp_loopback_input(l, p, p->bytes, p->size);
+    if (c) {
+      memmove(p->bytes, p->bytes + c, p->size - c);
+      p->size -= c;
+      moved += c;
+    }
+  }
+  return moved;
+}
+
+size_t amp_loopback_pump(amp_loopback_t *l)
+{
+  time_t now = amp_now();
+  for (int i = 0; i < 2; i++) {
+    amp_tick(l->pipes[i].from, now);
+    if (!amp_connection_dirty(l->connections[i])) continue;
+    if (l->callbacks[i]) l->callbacks[i](l->connections[i], l->contexts[i]);
+    amp_connection_clean(l->connections[i]);
+  }
+  size_t moved = 0;
+  for (int i = 0; i < 2; i++)
+    moved += amp_loopback_pipe_pump(l, &l->pipes[i]);
+  return moved;
+}
+
+size_t amp_loopback_run(amp_loopback_t *l)
+{
+  size_t passes = 0;
+  while (amp_loopback_pump(l)) passes++;
+  return passes;
+}
+
+size_t amp_loopback_frames(amp_loopback_t *l)
+{
+  return l->frames;
+}
+
+void amp_loopback_destroy(amp_loopback_t *l)
+{
+  if (!l) return;
+  for (int i = 0; i < 2; i++) {
+    free(l->pipes[i].bytes);
+    amp_destroy((amp_endpoint_t *) l->connections[i]);
+  }
+  free(l);
+}
@@ -25,6 +25,7 @@
 #include <amp/engine.h>
 #include <amp/value.h>
 #include "../util.h"
+#include "../protocol.h"
 
 #define DESCRIPTION (1024)
 
@@ -84,18 +85,48 @@ typedef struct {
   size_t handle_capacity;
 } amp_session_state_t;
 
+// an output buffer the ring has outgrown, kept around until the bytes
+// that were pending in it are consumed, as iovecs handed out by
+// amp_output_iov may still point into it
+typedef struct amp_retired_st amp_retired_t;
+struct amp_retired_st {
+  amp_retired_t *next;
+  amp_retired_t *prev;
+  char *output;
+  size_t until;//freed once consumed gets this far
+};
+
 #define SCRATCH (1024)
+#define MAX_FRAME (1024*1024)
 
 struct amp_transport_t {
   amp_endpoint_t endpoint;
   amp_connection_t *connection;
-  amp_map_t *dispatch;
+  amp_handler_t handlers[PERFORMATIVES];//indexed by *_IDX
+  amp_trace_level_t trace;
+  amp_trace_ring_t *sink;//where frames are traced to, stderr if NULL
   amp_list_t *args;
-  const char* payload_bytes;
-  size_t payload_size;
-  char *output;
-  size_t available;
+  char *output;//a ring of whole frames, see amp_output_reserve
+  size_t available;//pending bytes, wherever they are in the ring
   size_t capacity;
+  size_t head;//where the pending output starts
+  size_t tail;//where the next frame goes
+  size_t wrap;//where the older output ends once tail has wrapped, else 0
+  size_t consumed;//output consumed over the transport's lifetime
+  amp_retired_t *retired_head;//outgrown buffers, oldest first
+  amp_retired_t *retired_tail;
+  size_t incoming;//payload of incoming deliveries not yet received
+  uint32_t max_frame;
+  uint32_t remote_max_frame;//from the peer's OPEN, 0 until then
+  uint32_t idle_timeout;//ours as advertised in OPEN, 0 for none
+  uint32_t remote_idle_timeout;//the peer's, we keep it alive at half that
+  size_t frames_in;//frames received, heartbeats included
+  size_t frames_out;
+  size_t ticked_in;//frames_in/out as of the last amp_tick
+  size_t ticked_out;
+  time_t last_in;//when amp_tick last saw frames_in move
+  time_t last_out;
+  time_t last_tick;
   bool open_sent;
   bool close_sent;
   amp_session_state_t *sessions;
@@ -119,6 +150,7 @@ struct amp_connection_t {
   amp_delivery_t *work_tail;
   amp_delivery_t *tpwork_head;
   amp_delivery_t *tpwork_tail;
+  bool dirty;//something happened since the last amp_connection_clean
 };
 
 struct amp_session_t {
@@ -202,4 +234,19 @@ void amp_link_dump(amp_link_t *link);
 
 void amp_dump(amp_connection_t *conn);
 
+// the stock handlers, see amp_handler_t
+#define AMP_HANDLER(NAME) \
+  void NAME(amp_transport_t *transport, uint16_t channel,       \
+            amp_performative_t *performative, const char *payload, \
+            size_t size)
+AMP_HANDLER(amp_do_open);
+AMP_HANDLER(amp_do_begin);
+AMP_HANDLER(amp_do_attach);
+AMP_HANDLER(amp_do_flow);
+AMP_HANDLER(amp_do_transfer);
+AMP_HANDLER(amp_do_disposition);
+AMP_HANDLER(amp_do_detach);
+AMP_HANDLER(amp_do_end);
+AMP_HANDLER(amp_do_close);
+
 #endif /* engine-internal.h */
@@ -19,9 +19,12 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include "engine-internal.h"
 #include <stdlib.h>
 #include <string.h>
+#include <amp/codec.h>
 #include <amp/framing.h>
 #include <amp/value.h>
 #include "../protocol.h"
@@ -30,6 +33,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <time.h>
 
 // delivery buffers
 
@@ -188,7 +192,6 @@ void amp_destroy_connection(amp_connection_t *connection)
 
 void amp_destroy_transport(amp_transport_t *transport)
 {
-  amp_free_map(transport->dispatch);
   amp_free_list(transport->args);
   for (int i = 0; i < transport->session_capacity; i++) {
     amp_delivery_buffer_destroy(&transport->sessions[i].incoming);
@@ -198,6 +201,12 @@ void amp_destroy_transport(amp_transport_t *transport)
   }
   free(transport->sessions);
   free(transport->channels);
+  while (transport->retired_head) {
+    amp_retired_t *retired = transport->retired_head;
+    LL_POP(transport->retired_head, transport->retired_tail);
+    free(retired->output);
+    free(retired);
+  }
   free(transport->output);
   free(transport);
 }
@@ -371,6 +380,7 @@ void amp_close(amp_endpoint_t *endpoint)
 amp_connection_t *amp_connection()
 {
   amp_connection_t *conn = malloc(sizeof(amp_connection_t));
+  conn->dirty = true;
   conn->endpoint_head = NULL;
   conn->endpoint_tail = NULL;
   amp_endpoint_init(&conn->endpoint, CONNECTION, conn);
@@ -388,6 +398,16 @@ amp_connection_t *amp_connection()
   return conn;
 }
 
+bool amp_connection_dirty(amp_connection_t *connection)
+{
+  return connection->dirty;
+}
+
+void amp_connection_clean(amp_connection_t *connection)
+{
+  connection->dirty = false;
+}
+
 amp_delivery_t *amp_work_head(amp_connection_t *connection)
 {
   return connection->work_head;
@@ -421,6 +441,7 @@ void amp_clear_work(amp_connection_t *connection, amp_delivery_t *delivery)
 
 void amp_work_update(amp_connection_t *connection, amp_delivery_t *delivery)
 {
+  connection->dirty = true;
   amp_link_t *link = amp_link(delivery);
   amp_delivery_t *current = amp_current(link);
   if (delivery->dirty) {
@@ -476,6 +497,7 @@ void amp_dump(amp_connection_t *conn)
 
 void amp_modified(amp_connection_t *connection, amp_endpoint_t *endpoint)
 {
+  connection->dirty = true;
   if (!endpoint->modified) {
     LL_ADD_PFX(connection->transport_head, connection->transport_tail, endpoint, transport_);
     endpoint->modified = true;
@@ -537,32 +559,61 @@ amp_session_t *amp_session(amp_connection_t *conn)
   return ssn;
 }
 
-  /*  amp_map_set(MAP, amp_symbol(AMP_HEAP, NAME ## _SYM), amp_ulong(AMP_HEAP, NAME)); \ */
-#define __DISPATCH(MAP, NAME)                                           \
-  amp_map_set(MAP, amp_ulong(NAME ## _CODE), amp_ulong(NAME ## _IDX))
+// indexed by *_IDX, every transport starts out with a copy
+static const amp_handler_t AMP_HANDLERS[PERFORMATIVES] = {
+  [OPEN_IDX] = amp_do_open,
+  [BEGIN_IDX] = amp_do_begin,
+  [ATTACH_IDX] = amp_do_attach,
+  [FLOW_IDX] = amp_do_flow,
+  [TRANSFER_IDX] = amp_do_transfer,
+  [DISPOSITION_IDX] = amp_do_disposition,
+  [DETACH_IDX] = amp_do_detach,
+  [END_IDX] = amp_do_end,
+  [CLOSE_IDX] = amp_do_close
+};
+
+static amp_trace_level_t amp_trace_env()
+{
+  const char *level = getenv("AMP_TRACE");
+  if (level && !strcmp(level, "frames"))
+    return AMP_TRACE_FRAMES;
+  else if (level && !strcmp(level, "payload"))
+    return AMP_TRACE_PAYLOAD;
+  else
+    return AMP_TRACE_OFF;
+}
 
 void amp_transport_init(amp_transport_t *transport)
 {
   amp_endpoint_init(&transport->endpoint, TRANSPORT, transport->connection);
 
-  amp_map_t *m = amp_map(32);
-  transport->dispatch = m;
-
-  __DISPATCH(m, OPEN);
-  __DISPATCH(m, BEGIN);
-  __DISPATCH(m, ATTACH);
-  __DISPATCH(m, TRANSFER);
-  __DISPATCH(m, FLOW);
-  __DISPATCH(m, DISPOSITION);
-  __DISPATCH(m, DETACH);
-  __DISPATCH(m, END);
-  __DISPATCH(m, CLOSE);
+  memcpy(transport->handlers, AMP_HANDLERS, sizeof(AMP_HANDLERS));
+  transport->trace = amp_trace_env();
+  transport->sink = NULL;
 
   transport->args = amp_list(16);
   // XXX
   transport->capacity = 4*1024;
   transport->output = malloc(transport->capacity);
   transport->available = 0;
+  transport->head = 0;
+  transport->tail = 0;
+  transport->wrap = 0;
+  transport->consumed = 0;
+  transport->retired_head = NULL;
+  transport->retired_tail = NULL;
+  transport->incoming = 0;
+  transport->max_frame = MAX_FRAME;
+  transport->remote_max_frame = 0;
+  transport->idle_timeout = 0;
+  transport->remote_idle_timeout = 0;
+  transport->frames_in = 0;
+  transport->frames_out = 0;
+  transport->ticked_in = 0;
+  transport->ticked_out = 0;
+  transport->last_in = 0;
+  transport->last_out = 0;
+  transport->last_tick = 0;
 
   transport->open_sent = false;
   transport->close_sent = false;
@@ -707,13 +758,14 @@ amp_session_t *amp_get_session(amp_link_t *link)
   return link->session;
 }
 
-amp_delivery_t *amp_delivery(amp_link_t *link, amp_binary_t *tag)
+// the delivery takes the tag over
+static amp_delivery_t *amp_delivery_tagged(amp_link_t *link, amp_binary_t *tag)
 {
   amp_delivery_t *delivery = link->settled_head;
   LL_POP_PFX(link->settled_head, link->settled_tail, link_);
   if (!delivery) delivery = malloc(sizeof(amp_delivery_t));
   delivery->link = link;
-  delivery->tag = amp_binary_dup(tag);
+  delivery->tag = tag;
   delivery->local_state = 0;
   delivery->remote_state = 0;
   delivery->local_settled = false;
@@ -739,6 +791,11 @@ amp_delivery_t *amp_delivery(amp_link_t *link, amp_binary_t *tag)
   return delivery;
 }
 
+amp_delivery_t *amp_delivery(amp_link_t *link, amp_binary_t *tag)
+{
+  return amp_delivery_tagged(link, amp_binary_dup(tag));
+}
+
 bool amp_is_current(amp_delivery_t *delivery)
 {
   amp_link_t *link = delivery->link;
@@ -804,6 +861,10 @@ bool amp_advance(amp_link_t *link)
 void amp_real_settle(amp_delivery_t *delivery)
 {
   amp_link_t *link = delivery->link;
+  if (amp_endpoint_type(&link->endpoint) == RECEIVER) {
+    amp_transport_t *transport = link->session->connection->transport;
+    if (transport) transport->incoming -= delivery->size;
+  }
   LL_REMOVE_PFX(link->head, link->tail, delivery, link_);
   // TODO: what if we settle the current delivery?
   LL_ADD_PFX(link->settled_head, link->settled_tail, delivery, link_);
@@ -828,24 +889,157 @@ void amp_settle(amp_delivery_t *delivery)
 
 typedef enum {IN, OUT} amp_dir_t;
 
-static void amp_trace(amp_transport_t *transport, uint16_t ch, amp_dir_t dir,
-                      char *op, amp_list_t *args, const char *payload,
-                      size_t size)
+// ring entries are a header followed by the snap bytes, the seq of an
+// entry is zeroed while it is written and afterwards set to one more
+// than the sequence number it was written for, so a reader can tell
+// complete entries from ones that are in flux or have been lapped
+typedef struct {
+  uint64_t seq;
+  uint64_t time;//nanoseconds on the monotonic clock
+  uint32_t size;//of the whole frame
+  uint32_t kept;//how much of it follows
+  uint16_t channel;
+  uint8_t dir;
+} amp_trace_entry_t;
+
+struct amp_trace_ring_t {
+  size_t mask;
+  size_t snap;
+  size_t stride;//bytes from one entry to the next
+  uint64_t next;//sequence number of the next entry to write
+  char *entries;
+};
+
+amp_trace_ring_t *amp_trace_ring(size_t count, size_t snap)
+{
+  amp_trace_ring_t *ring = malloc(sizeof(amp_trace_ring_t));
+  if (!ring) return NULL;
+  size_t n = 1;
+  while (n < count) n *= 2;
+  ring->mask = n - 1;
+  ring->snap = snap;
+  ring->stride = (sizeof(amp_trace_entry_t) + snap + 7) & ~(size_t) 7;
+  ring->next = 0;
+  ring->entries = calloc(n, ring->stride);
+  if (!ring->entries) {
+    free(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+void amp_trace_ring_free(amp_trace_ring_t *ring)
+{
+  if (!ring) return;
+  free(ring->entries);
+  free(ring);
+}
+
+static amp_trace_entry_t *amp_trace_entry(amp_trace_ring_t *ring, uint64_t seq)
+{
+  return (amp_trace_entry_t *) (ring->entries + (seq & ring->mask)*ring->stride);
+}
+
+static void amp_trace_record(amp_trace_ring_t *ring, amp_dir_t dir, uint16_t ch,
+                             const char *bytes, size_t size, size_t kept)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t seq = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED);
+  amp_trace_entry_t *entry = amp_trace_entry(ring, seq);
+  __atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  entry->time = (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+  entry->size = size;
+  entry->kept = kept < ring->snap ? kept : ring->snap;
+  entry->channel = ch;
+  entry->dir = dir;
+  memcpy(entry + 1, bytes, entry->kept);
+  __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+void amp_trace_dump(amp_trace_ring_t *ring, FILE *out)
 {
-  amp_format(transport->scratch, SCRATCH, amp_from_list(args));
+  uint64_t end = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+  uint64_t count = ring->mask + 1;
+  char copy[ring->stride];
+  amp_trace_entry_t *entry = (amp_trace_entry_t *) copy;
+  for (uint64_t seq = end > count ? end - count : 0; seq < end; seq++) {
+    amp_trace_entry_t *live = amp_trace_entry(ring, seq);
+    if (__atomic_load_n(&live->seq, __ATOMIC_ACQUIRE) != seq + 1) continue;
+    memcpy(copy, live, ring->stride);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&live->seq, __ATOMIC_RELAXED) != seq + 1) continue;
+
+    fprintf(out, "%llu.%09llu [%u] %s (%u)",
+            (unsigned long long) (entry->time/1000000000),
+            (unsigned long long) (entry->time%1000000000),
+            entry->channel, entry->dir == OUT ? "->" : "<-", entry->size);
+    const unsigned char *bytes = (const unsigned char *) (entry + 1);
+    for (int i = 0; i < entry->kept; i++)
+      fprintf(out, "%s%.2x", i % 4 ? "" : " ", bytes[i]);
+    fprintf(out, "\n");
+  }
+}
+
+void amp_trace_set(amp_transport_t *transport, amp_trace_level_t level)
+{
+  transport->trace = level;
+}
+
+amp_trace_level_t amp_trace_get(amp_transport_t *transport)
+{
+  return transport->trace;
+}
+
+void amp_trace_sink(amp_transport_t *transport, amp_trace_ring_t *ring)
+{
+  transport->sink = ring;
+}
+
+// the raw side of tracing, the frame goes to the ring as it is on the
+// wire, less its trailing payload bytes unless those are wanted too
+static void amp_trace_raw(amp_transport_t *transport, amp_dir_t dir, uint16_t ch,
+                          const char *bytes, size_t size, size_t payload)
+{
+  if (transport->trace && transport->sink)
+    amp_trace_record(transport->sink, dir, ch, bytes, size,
+                     transport->trace >= AMP_TRACE_PAYLOAD ? size : size - payload);
+}
+
+// performative is as encoded, it only gets decoded when there is
+// something to print
+static void amp_trace(amp_transport_t *transport, uint16_t ch, amp_dir_t dir,
+                      const char *op, char *performative, size_t n,
+                      const char *payload, size_t size)
+{
+  if (!transport->trace || transport->sink) return;
+  amp_value_t value;
+  transport->scratch[0] = '\0';
+  if (n && amp_decode(&value, performative, n) >= 0) {
+    amp_format(transport->scratch, SCRATCH, value.type == TAG ?
+               amp_tag_value(amp_to_tag(value)) : value);
+    amp_visit(value, amp_free_value);
+  }
   fprintf(stderr, "[%u] %s %s %s", ch, dir == OUT ? "->" : "<-", op,
           transport->scratch);
-  if (size) {
+  if (size && transport->trace >= AMP_TRACE_PAYLOAD) {
     fprintf(stderr, " (%zu) \"", size);
-    for (int i = 0; i < size; i++) {
-      char c = payload[i];
-      if (isprint(c)) {
-        fputc(c, stderr);
+    // printable runs go out in one piece
+    size_t i = 0;
+    while (i < size) {
+      size_t run = 0;
+      while (i + run < size && isprint(payload[i + run])) run++;
+      if (run) {
+        fwrite(payload + i, 1, run, stderr);
+        i += run;
       } else {
-        fprintf(stderr, "\\x%.2x", c);
+        fprintf(stderr, "\\x%.2x", payload[i++]);
       }
     }
     fprintf(stderr, "\"\n");
+  } else if (size) {
+    fprintf(stderr, " (%zu)\n", size);
   } else {
     fprintf(stderr, "\n");
   }
@@ -864,20 +1058,24 @@ void amp_do_error(amp_transport_t *transport, const char *condition, const char
   // XXX: need to write close frame if appropriate
 }
 
-void amp_do_open(amp_transport_t *transport, amp_list_t *args)
+void amp_do_open(amp_transport_t *transport, uint16_t ch, amp_performative_t *performative, const char *payload, size_t size)
 {
   amp_connection_t *conn = transport->connection;
-  // TODO: store the state
+  amp_open_fields_t *open = &performative->open;
+  if (amp_present(open, OPEN_MAX_FRAME_SIZE))
+    transport->remote_max_frame = open->max_frame_size;
+  if (amp_present(open, OPEN_IDLE_TIME_OUT))
+    transport->remote_idle_timeout = open->idle_time_out;
   conn->endpoint.remote_state = ACTIVE;
 }
 
-void amp_do_begin(amp_transport_t *transport, uint16_t ch, amp_list_t *args)
+void amp_do_begin(amp_transport_t *transport, uint16_t ch, amp_performative_t *performative, const char *payload, size_t size)
 {
-  amp_value_t remote_channel = amp_list_get(args, BEGIN_REMOTE_CHANNEL);
+  amp_begin_fields_t *begin = &performative->begin;
   amp_session_state_t *state;
-  if (remote_channel.type == USHORT) {
+  if (amp_present(begin, BEGIN_REMOTE_CHANNEL)) {
     // XXX: what if session is NULL?
-    state = &transport->sessions[amp_to_uint16(remote_channel)];
+    state = &transport->sessions[begin->remote_channel];
   } else {
     amp_session_t *ssn = amp_session(transport->connection);
     state = amp_session_state(transport, ssn);
@@ -899,11 +1097,26 @@ amp_link_state_t *amp_find_link(amp_session_state_t *ssn_state, amp_string_t *na
   return NULL;
 }
 
-void amp_do_attach(amp_transport_t *transport, uint16_t ch, amp_list_t *args)
+// the address of a source or target, if it is a string
+static wchar_t *amp_address(amp_bytes_t *address)
+{
+  char *pos = address->start;
+  size_t size;
+  char *utf8;
+  if (amp_read_utf8(&pos, address->start + address->size, &size, &utf8))
+    return NULL;
+  amp_string_t *str = amp_string_utf8(utf8, size);
+  wchar_t *wcs = wcsdup(amp_string_wcs(str));
+  amp_free_string(str);
+  return wcs;
+}
+
+void amp_do_attach(amp_transport_t *transport, uint16_t ch, amp_performative_t *performative, const char *payload, size_t size)
 {
-  uint32_t handle = amp_to_uint32(amp_list_get(args, ATTACH_HANDLE));
-  bool is_sender = amp_to_bool(amp_list_get(args, ATTACH_ROLE));
-  amp_string_t *name = amp_to_string(amp_list_get(args, ATTACH_NAME));
+  amp_attach_fields_t *attach = &performative->attach;
+  uint32_t handle = attach->handle;
+  bool is_sender = attach->role;
+  amp_string_t *name = amp_string_utf8(attach->name.start, attach->name.size);
   amp_session_state_t *ssn_state = amp_channel_state(transport, ch);
   amp_link_state_t *link_state = amp_find_link(ssn_state, name);
   if (!link_state) {
@@ -918,37 +1131,43 @@ void amp_do_attach(amp_transport_t *transport, uint16_t ch, amp_list_t *args)
 
   amp_map_handle(ssn_state, handle, link_state);
   link_state->link->endpoint.remote_state = ACTIVE;
-  amp_value_t remote_source = amp_list_get(args, ATTACH_SOURCE);
-  if (remote_source.type == TAG)
-    remote_source = amp_tag_value(amp_to_tag(remote_source));
-  amp_value_t remote_target = amp_list_get(args, ATTACH_TARGET);
-  if (remote_target.type == TAG)
-    remote_target = amp_tag_value(amp_to_tag(remote_target));
+  amp_free_string(name);
+
+  amp_source_fields_t source;
+  amp_target_fields_t target;
+  char *pos;
   // XXX: dup src/tgt
-  if (remote_source.type == LIST)
-    link_state->link->remote_source = wcsdup(amp_string_wcs(amp_to_string(amp_list_get(amp_to_list(remote_source), SOURCE_ADDRESS))));
-  if (remote_target.type == LIST)
-    link_state->link->remote_target = wcsdup(amp_string_wcs(amp_to_string(amp_list_get(amp_to_list(remote_target), TARGET_ADDRESS))));
+  pos = attach->source.start;
+  if (amp_present(attach, ATTACH_SOURCE) &&
+      !amp_read_source(&pos, pos + attach->source.size, &source) &&
+      amp_present(&source, SOURCE_ADDRESS))
+    link_state->link->remote_source = amp_address(&source.address);
+  pos = attach->target.start;
+  if (amp_present(attach, ATTACH_TARGET) &&
+      !amp_read_target(&pos, pos + attach->target.size, &target) &&
+      amp_present(&target, TARGET_ADDRESS))
+    link_state->link->remote_target = amp_address(&target.address);
 
   if (!is_sender) {
-    link_state->delivery_count = amp_to_int32(amp_list_get(args, ATTACH_INITIAL_DELIVERY_COUNT));
+    link_state->delivery_count = attach->initial_delivery_count;
   }
 }
 
-void amp_do_transfer(amp_transport_t *transport, uint16_t channel, amp_list_t *args, const char *payload_bytes, size_t payload_size)
+void amp_do_transfer(amp_transport_t *transport, uint16_t channel, amp_performative_t *performative,
+                     const char *payload_bytes, size_t payload_size)
 {
   // XXX: multi transfer
 
+  amp_transfer_fields_t *transfer = &performative->transfer;
   amp_session_state_t *ssn_state = amp_channel_state(transport, channel);
-  uint32_t handle = amp_to_uint32(amp_list_get(args, TRANSFER_HANDLE));
-  amp_link_state_t *link_state = amp_handle_state(ssn_state, handle);
+  amp_link_state_t *link_state = amp_handle_state(ssn_state, transfer->handle);
   amp_link_t *link = link_state->link;
-  amp_binary_t *tag = amp_to_binary(amp_list_get(args, TRANSFER_DELIVERY_TAG));
-  amp_delivery_t *delivery = amp_delivery(link, tag);
+  amp_binary_t *tag = amp_binary(transfer->delivery_tag.start, transfer->delivery_tag.size);
+  amp_delivery_t *delivery = amp_delivery_tagged(link, tag);
   amp_delivery_state_t *state = amp_delivery_buffer_push(&ssn_state->incoming, delivery);
   delivery->context = state;
   // XXX: need to check that state is not null (i.e. we haven't hit the limit)
-  amp_sequence_t id = amp_to_int32(amp_list_get(args, TRANSFER_DELIVERY_ID));
+  amp_sequence_t id = transfer->delivery_id;
   if (id != state->id) {
     // XXX: signal error somehow
   }
@@ -956,27 +1175,26 @@ void amp_do_transfer(amp_transport_t *transport, uint16_t channel, amp_list_t *a
   AMP_ENSURE(delivery->bytes, delivery->capacity, payload_size);
   memmove(delivery->bytes, payload_bytes, payload_size);
   delivery->size = payload_size;
+  transport->incoming += payload_size;
 }
 
-void amp_do_flow(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
+void amp_do_flow(amp_transport_t *transport, uint16_t channel, amp_performative_t *performative, const char *payload, size_t size)
 {
   amp_session_state_t *ssn_state = amp_channel_state(transport, channel);
+  amp_flow_fields_t *flow = &performative->flow;
 
-  amp_value_t vhandle = amp_list_get(args, FLOW_HANDLE);
-  if (vhandle.type != EMPTY) {
-    uint32_t handle = amp_to_uint32(vhandle);
-    amp_link_state_t *link_state = amp_handle_state(ssn_state, handle);
+  if (amp_present(flow, FLOW_HANDLE)) {
+    amp_link_state_t *link_state = amp_handle_state(ssn_state, flow->handle);
     amp_link_t *link = link_state->link;
     if (link->endpoint.type == SENDER) {
-      amp_value_t delivery_count = amp_list_get(args, FLOW_DELIVERY_COUNT);
       amp_sequence_t receiver_count;
-      if (delivery_count.type == EMPTY) {
+      if (!amp_present(flow, FLOW_DELIVERY_COUNT)) {
         // our initial delivery count
         receiver_count = 0;
       } else {
-        receiver_count = amp_to_int32(delivery_count);
+        receiver_count = flow->delivery_count;
       }
-      amp_sequence_t link_credit = amp_to_uint32(amp_list_get(args, FLOW_LINK_CREDIT));
+      amp_sequence_t link_credit = flow->link_credit;
       link->credit = receiver_count + link_credit - link_state->delivery_count;
       amp_delivery_t *delivery = amp_current(link);
       if (delivery) amp_work_update(transport->connection, delivery);
@@ -984,15 +1202,27 @@ void amp_do_flow(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
   }
 }
 
-void amp_do_disposition(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
+void amp_do_disposition(amp_transport_t *transport, uint16_t channel, amp_performative_t *performative, const char *payload, size_t size)
 {
   amp_session_state_t *ssn_state = amp_channel_state(transport, channel);
-  bool role = amp_to_bool(amp_list_get(args, DISPOSITION_ROLE));
-  amp_sequence_t first = amp_to_int32(amp_list_get(args, DISPOSITION_FIRST));
-  amp_sequence_t last = amp_to_int32(amp_list_get(args, DISPOSITION_LAST));
-  //bool settled = amp_to_bool(amp_list_get(args, DISPOSITION_SETTLED));
-  amp_tag_t *dstate = amp_to_tag(amp_list_get(args, DISPOSITION_STATE));
-  uint64_t code = amp_to_uint32(amp_tag_descriptor(dstate));
+  amp_disposition_fields_t *disposition = &performative->disposition;
+  bool role = disposition->role;
+  amp_sequence_t first = disposition->first;
+  amp_sequence_t last = amp_present(disposition, DISPOSITION_LAST) ?
+    disposition->last : first;
+  //bool settled = disposition->settled;
+  uint64_t code = 0;
+  size_t symsize;
+  char *sym;
+  char *pos = disposition->state.start;
+  // the outcome may be named rather than numbered
+  if (amp_present(disposition, DISPOSITION_STATE) &&
+      amp_read_descriptor(&pos, pos + disposition->state.size, &code, &symsize, &sym) == 1) {
+    if (symsize == strlen(ACCEPTED_SYM) && !memcmp(sym, ACCEPTED_SYM, symsize))
+      code = ACCEPTED_CODE;
+    else if (symsize == strlen(REJECTED_SYM) && !memcmp(sym, REJECTED_SYM, symsize))
+      code = REJECTED_CODE;
+  }
   amp_disposition_t disp;
   switch (code)
   {
@@ -1027,10 +1257,10 @@ void amp_do_disposition(amp_transport_t *transport, uint16_t channel, amp_list_t
   }
 }
 
-void amp_do_detach(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
+void amp_do_detach(amp_transport_t *transport, uint16_t channel, amp_performative_t *performative, const char *payload, size_t size)
 {
-  uint32_t handle = amp_to_uint32(amp_list_get(args, DETACH_HANDLE));
-  bool closed = amp_to_bool(amp_list_get(args, DETACH_CLOSED));
+  uint32_t handle = performative->detach.handle;
+  bool closed = performative->detach.closed;
 
   amp_session_state_t *ssn_state = amp_channel_state(transport, channel);
   if (!ssn_state) {
@@ -1050,7 +1280,7 @@ void amp_do_detach(amp_transport_t *transport, uint16_t channel, amp_list_t *arg
   }
 }
 
-void amp_do_end(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
+void amp_do_end(amp_transport_t *transport, uint16_t channel, amp_performative_t *performative, const char *payload, size_t size)
 {
   amp_session_state_t *ssn_state = amp_channel_state(transport, channel);
   amp_session_t *session = ssn_state->session;
@@ -1059,81 +1289,35 @@ void amp_do_end(amp_transport_t *transport, uint16_t channel, amp_list_t *args)
   session->endpoint.remote_state = CLOSED;
 }
 
-void amp_do_close(amp_transport_t *transport, amp_list_t *args)
+void amp_do_close(amp_transport_t *transport, uint16_t ch, amp_performative_t *performative, const char *payload, size_t size)
 {
   transport->connection->endpoint.remote_state = CLOSED;
   transport->endpoint.remote_state = CLOSED;
 }
 
-static char *amp_p2op(uint32_t performative)
+static const char *amp_p2op(uint64_t performative)
 {
-  switch (performative)
-  {
-  case OPEN_CODE:
-    return "OPEN";
-  case BEGIN_CODE:
-    return "BEGIN";
-  case ATTACH_CODE:
-    return "ATTACH";
-  case TRANSFER_CODE:
-    return "TRANSFER";
-  case FLOW_CODE:
-    return "FLOW";
-  case DISPOSITION_CODE:
-    return "DISPOSITION";
-  case DETACH_CODE:
-    return "DETACH";
-  case END_CODE:
-    return "END";
-  case CLOSE_CODE:
-    return "CLOSE";
-  default:
-    return "<UNKNOWN>";
-  }
+  return amp_performative_name(amp_performative_code(performative));
 }
 
-void amp_dispatch(amp_transport_t *transport, uint16_t channel,
-                  amp_tag_t *performative, const char *payload_bytes,
-                  size_t payload_size)
+amp_handler_t amp_set_handler(amp_transport_t *transport, uint64_t code,
+                              amp_handler_t handler)
 {
-  amp_value_t desc = amp_tag_descriptor(performative);
-  amp_list_t *args = amp_to_list(amp_tag_value(performative));
-  amp_value_t cval = amp_map_get(transport->dispatch, desc);
-  uint8_t code = amp_to_uint8(cval);
-
-  amp_trace(transport, channel, IN, amp_p2op(amp_to_uint32(desc)), args,
-            payload_bytes, payload_size);
+  int idx = amp_performative_code(code);
+  if (idx < 0) return NULL;
+  amp_handler_t previous = transport->handlers[idx];
+  transport->handlers[idx] = handler;
+  return previous;
+}
 
-  switch (code)
-  {
-  case OPEN_IDX:
-    amp_do_open(transport, args);
-    break;
-  case BEGIN_IDX:
-    amp_do_begin(transport, channel, args);
-    break;
-  case ATTACH_IDX:
-    amp_do_attach(transport, channel, args);
-    break;
-  case TRANSFER_IDX:
-    amp_do_transfer(transport, channel, args, payload_bytes, payload_size);
-    break;
-  case FLOW_IDX:
-    amp_do_flow(transport, channel, args);
-    break;
-  case DISPOSITION_IDX:
-    amp_do_disposition(transport, channel, args);
-    break;
-  case DETACH_IDX:
-    amp_do_detach(transport, channel, args);
-    break;
-  case END_IDX:
-    amp_do_end(transport, channel, args);
-    break;
-  case CLOSE_IDX:
-    amp_do_close(transport, args);
-    break;
-  }
+// idx is -1 for a performative that isn't known
+void amp_dispatch(amp_transport_t *transport, uint16_t channel, int idx,
+                  amp_performative_t *performative, const char *payload_bytes,
+                  size_t payload_size)
+{
+  if (idx >= 0 && transport->handlers[idx])
+    transport->handlers[idx](transport, channel, performative, payload_bytes,
+                             payload_size);
 }
 
 ssize_t amp_input(amp_transport_t *transport, char *bytes, size_t available)
@@ -1152,18 +1336,39 @@ ssize_t amp_input(amp_transport_t *transport, char *bytes, size_t available)
     amp_frame_t frame;
     size_t n = amp_read_frame(&frame, bytes + read, available);
     if (n) {
-      amp_value_t performative;
-      ssize_t e = amp_decode(&performative, frame.payload, frame.size);
-      if (e < 0) {
-        fprintf(stderr, "Error decoding frame: %zi\n", e);
+      transport->frames_in++;
+      // an empty frame only serves to keep the connection alive
+      if (!frame.size) {
+        amp_trace_raw(transport, IN, frame.channel, bytes + read, n, 0);
+        amp_trace(transport, frame.channel, IN, "EMPTY", NULL, 0, NULL, 0);
+        available -= n;
+        read += n;
+        continue;
+      }
+
+      // the fields are read in place, nothing is allocated for them
+      amp_performative_t performative;
+      int idx;
+      char *pos = frame.payload;
+      int err = amp_read_performative(&pos, frame.payload + frame.size, &idx,
+                                      &performative);
+      if (err) {
+        fprintf(stderr, "Error decoding frame: %i\n", err);
         amp_format(transport->scratch, SCRATCH, amp_value("z", frame.size, frame.payload));
         fprintf(stderr, "%s\n", transport->scratch);
-        return e;
+        return err;
       }
 
-      amp_tag_t *perf = amp_to_tag(performative);
-      amp_dispatch(transport, frame.channel, perf, frame.payload + e, frame.size - e);
-      amp_visit(performative, amp_free_value);
+      size_t e = pos - frame.payload;
+      amp_trace_raw(transport, IN, frame.channel, bytes + read, n, frame.size - e);
+      amp_trace(transport, frame.channel, IN, amp_performative_name(idx),
+                frame.payload, e, pos, frame.size - e);
+      if (idx < 0) {
+        amp_do_error(transport, "amqp:decode-error", "unknown performative");
+        read += n;
+        break;
+      }
+      amp_dispatch(transport, frame.channel, idx, &performative, pos, frame.size - e);
 
       available -= n;
       read += n;
@@ -1172,14 +1377,13 @@ ssize_t amp_input(amp_transport_t *transport, char *bytes, size_t available)
     }
   }
 
+  if (read) transport->connection->dirty = true;
   return read;
 }
 
 void amp_init_frame(amp_transport_t *transport)
 {
   amp_list_clear(transport->args);
-  transport->payload_bytes = NULL;
-  transport->payload_size = 0;
 }
 
 void amp_field(amp_transport_t *transport, int index, amp_value_t arg)
@@ -1190,41 +1394,136 @@ void amp_field(amp_transport_t *transport, int index, amp_value_t arg)
   amp_list_set(transport->args, index, arg);
 }
 
-void amp_append_payload(amp_transport_t *transport, const char *data, size_t size)
-{
-  transport->payload_bytes = data;
-  transport->payload_size = size;
-}
-
 #define BUF_SIZE (1024*1024)
 
+// Makes room for n contiguous bytes of output at the tail. Frames never
+// straddle the end of the ring: when one does not fit there it goes at
+// the front, ahead of the pending output, and wrap marks where the
+// older part stops. Consuming output only moves the head along. The
+// ring is only ever copied when it has to grow, and then in one step.
+// The old buffer lives on until its pending bytes are consumed, so
+// iovecs into it stay good. Returns NULL when it cannot grow, the
+// output is left as it was.
+static char *amp_output_reserve(amp_transport_t *transport, size_t n)
+{
+  if (transport->wrap) {
+    if (transport->head - transport->tail >= n)
+      return transport->output + transport->tail;
+  } else {
+    if (transport->capacity - transport->tail >= n)
+      return transport->output + transport->tail;
+    if (transport->head >= n) {
+      transport->wrap = transport->tail;
+      transport->tail = 0;
+      return transport->output;
+    }
+  }
+
+  size_t capacity = transport->capacity;
+  while (capacity < transport->available + n) capacity *= 2;
+  char *output = malloc(capacity);
+  amp_retired_t *retired = transport->available ? malloc(sizeof(amp_retired_t)) : NULL;
+  if (!output || (transport->available && !retired)) {
+    free(output);
+    free(retired);
+    return NULL;
+  }
+  size_t size = 0;
+  if (transport->wrap) {
+    size = transport->wrap - transport->head;
+    memcpy(output, transport->output + transport->head, size);
+    transport->head = 0;
+  }
+  memcpy(output + size, transport->output + transport->head,
+         transport->tail - transport->head);
+  if (retired) {
+    retired->output = transport->output;
+    retired->until = transport->consumed + transport->available;
+    LL_ADD(transport->retired_head, transport->retired_tail, retired);
+  } else {
+    free(transport->output);
+  }
+  transport->output = output;
+  transport->capacity = capacity;
+  transport->head = 0;
+  transport->tail = transport->available;
+  transport->wrap = 0;
+  return transport->output + transport->tail;
+}
+
+// takes the size bytes reserved at the tail as a frame, payload is how
+// many of its trailing bytes are message payload
+static void amp_output_frame(amp_transport_t *transport, uint16_t ch, size_t size,
+                             size_t payload)
+{
+  char *start = transport->output + transport->tail;
+  amp_write_frame_header(start, size, 0, ch);
+  amp_trace_raw(transport, OUT, ch, start, size, payload);
+  transport->tail += size;
+  transport->available += size;
+  transport->frames_out++;
+}
+
+// a frame that could not be written in full is never framed, the
+// peer would be left with a broken stream, so we give up on it instead
+static void amp_output_failed(amp_transport_t *transport, const char *name)
+{
+  amp_do_error(transport, "amqp:internal-error", "can't write %s frame", name);
+}
+
+// the performative is encoded straight into the output buffer behind
+// room for the frame header, which is filled in once the size is known,
+// and the payload is copied in right after it
+static void amp_post_performative(amp_transport_t *transport, uint16_t ch, int idx,
+                                  amp_performative_t *performative,
+                                  const char *payload, size_t size)
+{
+  size_t n = AMQP_HEADER_SIZE + size + amp_sizeof_performative(idx, performative);
+  char *start = amp_output_reserve(transport, n);
+  char *pos = start ? start + AMQP_HEADER_SIZE : NULL;
+  // the limit leaves the payload's room alone, so a performative that
+  // came out larger than amp_sizeof_performative said fails here
+  if (!start || amp_write_performative(&pos, start + n - size, idx, performative)) {
+    amp_output_failed(transport, amp_performative_name(idx));
+    return;
+  }
+  amp_trace(transport, ch, OUT, amp_performative_name(idx), start + AMQP_HEADER_SIZE,
+            pos - start - AMQP_HEADER_SIZE, payload, size);
+  if (size) {
+    memcpy(pos, payload, size);
+    pos += size;
+  }
+  amp_output_frame(transport, ch, pos - start, size);
+}
+
+// the same for fields set with amp_field, for those with wide strings
 void amp_post_frame(amp_transport_t *transport, uint16_t ch, uint32_t performative)
 {
   amp_tag_t tag = { .descriptor = amp_ulong(performative),
                     .value = amp_from_list(transport->args) };
-  amp_frame_t frame = {0};
-  char bytes[amp_encode_sizeof(amp_from_tag(&tag)) + transport->payload_size];
-  amp_trace(transport, ch, OUT, amp_p2op(performative), transport->args,
-            transport->payload_bytes, transport->payload_size);
-  size_t size = amp_encode(amp_from_tag(&tag), bytes);
+  char *start = amp_output_reserve(transport, AMQP_HEADER_SIZE +
+                                   amp_encode_sizeof_tag(&tag));
+  char *pos = start;
+  if (start) pos += AMQP_HEADER_SIZE + amp_encode_tag(&tag, start + AMQP_HEADER_SIZE);
   for (int i = 0; i < amp_list_size(transport->args); i++)
     amp_visit(amp_list_get(transport->args, i), amp_free_value);
-  if (transport->payload_size) {
-    memmove(bytes + size, transport->payload_bytes, transport->payload_size);
-    size += transport->payload_size;
-    transport->payload_bytes = NULL;
-    transport->payload_size = 0;
-  }
-  frame.channel = ch;
-  frame.payload = bytes;
-  frame.size = size;
-  size_t n;
-  while (!(n = amp_write_frame(transport->output + transport->available,
-                               transport->capacity - transport->available, frame))) {
-    transport->capacity *= 2;
-    transport->output = realloc(transport->output, transport->capacity);
+  if (!start) {
+    amp_output_failed(transport, amp_p2op(performative));
+    return;
   }
-  transport->available += n;
+  amp_trace(transport, ch, OUT, amp_p2op(performative), start + AMQP_HEADER_SIZE,
+            pos - start - AMQP_HEADER_SIZE, NULL, 0);
+  amp_output_frame(transport, ch, pos - start, 0);
+}
+
+// an empty frame carries nothing but the fact that we are still here
+static void amp_post_empty_frame(amp_transport_t *transport)
+{
+  amp_trace(transport, 0, OUT, "EMPTY", NULL, 0, NULL, 0);
+  if (amp_output_reserve(transport, AMQP_HEADER_SIZE))
+    amp_output_frame(transport, 0, AMQP_HEADER_SIZE, 0);
+  else
+    amp_output_failed(transport, "EMPTY");
 }
 
 void amp_process_conn_setup(amp_transport_t *transport, amp_endpoint_t *endpoint)
@@ -1233,12 +1532,16 @@ void amp_process_conn_setup(amp_transport_t *transport, amp_endpoint_t *endpoint
   {
     if (endpoint->local_state != UNINIT && !transport->open_sent)
     {
-      amp_init_frame(transport);
+      amp_performative_t performative = {{0}};
+      amp_open_fields_t *open = &performative.open;
       /*if (container_id)
-        amp_field(eng, OPEN_CONTAINER_ID, amp_value("S", container_id));*/
+        amp_set_field(open, OPEN_CONTAINER_ID, container_id, ...);*/
       /*if (hostname)
-        amp_field(eng, OPEN_HOSTNAME, amp_value("S", hostname));*/
-      amp_post_frame(transport, 0, OPEN_CODE);
+        amp_set_field(open, OPEN_HOSTNAME, hostname, ...);*/
+      amp_set_field(open, OPEN_MAX_FRAME_SIZE, max_frame_size, transport->max_frame);
+      if (transport->idle_timeout)
+        amp_set_field(open, OPEN_IDLE_TIME_OUT, idle_time_out, transport->idle_timeout);
+      amp_post_performative(transport, 0, OPEN_IDX, &performative, NULL, 0);
       transport->open_sent = true;
     }
   }
@@ -1252,16 +1555,17 @@ void amp_process_ssn_setup(amp_transport_t *transport, amp_endpoint_t *endpoint)
     amp_session_state_t *state = amp_session_state(transport, ssn);
     if (endpoint->local_state != UNINIT && state->local_channel == (uint16_t) -1)
     {
-      amp_init_frame(transport);
+      amp_performative_t performative = {{0}};
+      amp_begin_fields_t *begin = &performative.begin;
       if ((int16_t) state->remote_channel >= 0)
-        amp_field(transport, BEGIN_REMOTE_CHANNEL, amp_value("H", state->remote_channel));
-      amp_field(transport, BEGIN_NEXT_OUTGOING_ID, amp_value("I", state->outgoing.next));
-      amp_field(transport, BEGIN_INCOMING_WINDOW, amp_value("I", state->incoming.capacity));
-      amp_field(transport, BEGIN_OUTGOING_WINDOW, amp_value("I", state->outgoing.capacity));
+        amp_set_field(begin, BEGIN_REMOTE_CHANNEL, remote_channel, state->remote_channel);
+      amp_set_field(begin, BEGIN_NEXT_OUTGOING_ID, next_outgoing_id, state->outgoing.next);
+      amp_set_field(begin, BEGIN_INCOMING_WINDOW, incoming_window, state->incoming.capacity);
+      amp_set_field(begin, BEGIN_OUTGOING_WINDOW, outgoing_window, state->outgoing.capacity);
       // XXX: we use the session id as the outgoing channel, we depend
       // on this for looking up via remote channel
       uint16_t channel = ssn->id;
-      amp_post_frame(transport, channel, BEGIN_CODE);
+      amp_post_performative(transport, channel, BEGIN_IDX, &performative, NULL, 0);
       state->local_channel = channel;
     }
   }
@@ -1306,15 +1610,17 @@ void amp_process_flow_receiver(amp_transport_t *transport, amp_endpoint_t *endpo
       state->link_credit += rcv->credits;
       rcv->credits = 0;
 
-      amp_init_frame(transport);
-      //amp_field(transport, FLOW_NEXT_INCOMING_ID, amp_value("I", ssn_state->next_incoming_id));
-      amp_field(transport, FLOW_INCOMING_WINDOW, amp_value("I", ssn_state->incoming.capacity));
-      amp_field(transport, FLOW_NEXT_OUTGOING_ID, amp_value("I", ssn_state->outgoing.next));
-      amp_field(transport, FLOW_OUTGOING_WINDOW, amp_value("I", ssn_state->outgoing.capacity));
-      amp_field(transport, FLOW_HANDLE, amp_value("I", state->local_handle));
-      //amp_field(transport, FLOW_DELIVERY_COUNT, amp_value("I", delivery_count));
-      amp_field(transport, FLOW_LINK_CREDIT, amp_value("I", state->link_credit));
-      amp_post_frame(transport, ssn_state->local_channel, FLOW_CODE);
+      amp_performative_t performative = {{0}};
+      amp_flow_fields_t *flow = &performative.flow;
+      //amp_set_field(flow, FLOW_NEXT_INCOMING_ID, next_incoming_id, ssn_state->next_incoming_id);
+      amp_set_field(flow, FLOW_INCOMING_WINDOW, incoming_window, ssn_state->incoming.capacity);
+      amp_set_field(flow, FLOW_NEXT_OUTGOING_ID, next_outgoing_id, ssn_state->outgoing.next);
+      amp_set_field(flow, FLOW_OUTGOING_WINDOW, outgoing_window, ssn_state->outgoing.capacity);
+      amp_set_field(flow, FLOW_HANDLE, handle, state->local_handle);
+      //amp_set_field(flow, FLOW_DELIVERY_COUNT, delivery_count, delivery_count);
+      amp_set_field(flow, FLOW_LINK_CREDIT, link_credit, state->link_credit);
+      amp_post_performative(transport, ssn_state->local_channel, FLOW_IDX, &performative,
+                            NULL, 0);
     }
   }
 }
@@ -1325,28 +1631,33 @@ void amp_post_disp(amp_transport_t *transport, amp_delivery_t *delivery)
   amp_session_state_t *ssn_state = amp_session_state(transport, link->session);
   // XXX: check for null state
   amp_delivery_state_t *state = delivery->context;
-  amp_init_frame(transport);
-  amp_field(transport, DISPOSITION_ROLE, amp_boolean(link->endpoint.type == RECEIVER));
-  amp_field(transport, DISPOSITION_FIRST, amp_uint(state->id));
-  amp_field(transport, DISPOSITION_LAST, amp_uint(state->id));
+  amp_performative_t performative = {{0}};
+  amp_disposition_fields_t *disposition = &performative.disposition;
+  amp_set_field(disposition, DISPOSITION_ROLE, role, link->endpoint.type == RECEIVER);
+  amp_set_field(disposition, DISPOSITION_FIRST, first, state->id);
+  amp_set_field(disposition, DISPOSITION_LAST, last, state->id);
   // XXX
-  amp_field(transport, DISPOSITION_SETTLED, amp_boolean(delivery->local_settled));
-  uint64_t code;
+  amp_set_field(disposition, DISPOSITION_SETTLED, settled, delivery->local_settled);
+  char outcome[32];
+  char *pos = outcome;
+  char *limit = outcome + sizeof(outcome);
   switch(delivery->local_state) {
   case ACCEPTED:
-    code = ACCEPTED_CODE;
+    amp_write_accepted(&pos, limit, &(amp_accepted_fields_t) {0});
     break;
   case RELEASED:
-    code = RELEASED_CODE;
+    amp_write_released(&pos, limit, &(amp_released_fields_t) {0});
     break;
     //TODO: rejected and modified (both take extra data which may need to be passed through somehow) e.g. change from enum to discriminated union?
   default:
-    code = 0;
+    break;
   }
-  if (code)
-    amp_field(transport, DISPOSITION_STATE, amp_value("L([])", code));
-  //amp_field(transport, DISPOSITION_BATCHABLE, amp_boolean(batchable));
-  amp_post_frame(transport, ssn_state->local_channel, DISPOSITION_CODE);
+  if (pos > outcome)
+    amp_set_field(disposition, DISPOSITION_STATE, state,
+                  ((amp_bytes_t) {pos - outcome, outcome}));
+  //amp_set_field(disposition, DISPOSITION_BATCHABLE, batchable, batchable);
+  amp_post_performative(transport, ssn_state->local_channel, DISPOSITION_IDX,
+                        &performative, NULL, 0);
 }
 
 void amp_process_disp_receiver(amp_transport_t *transport, amp_endpoint_t *endpoint)
@@ -1392,16 +1703,21 @@ void amp_process_msg_data(amp_transport_t *transport, amp_endpoint_t *endpoint)
           delivery->context = state;
         }
         if (!state->sent && (int16_t) ssn_state->local_channel >= 0 && (int32_t) link_state->local_handle >= 0) {
-          amp_init_frame(transport);
-          amp_field(transport, TRANSFER_HANDLE, amp_value("I", link_state->local_handle));
-          amp_field(transport, TRANSFER_DELIVERY_ID, amp_value("I", state->id));
-          amp_field(transport, TRANSFER_DELIVERY_TAG, amp_from_binary(amp_binary_dup(delivery->tag)));
-          amp_field(transport, TRANSFER_MESSAGE_FORMAT, amp_value("I", 0));
+          amp_performative_t performative = {{0}};
+          amp_transfer_fields_t *transfer = &performative.transfer;
+          amp_set_field(transfer, TRANSFER_HANDLE, handle, link_state->local_handle);
+          amp_set_field(transfer, TRANSFER_DELIVERY_ID, delivery_id, state->id);
+          amp_set_field(transfer, TRANSFER_DELIVERY_TAG, delivery_tag,
+                        ((amp_bytes_t) {amp_binary_size(delivery->tag),
+                                        amp_binary_bytes(delivery->tag)}));
+          amp_set_field(transfer, TRANSFER_MESSAGE_FORMAT, message_format, 0);
+          size_t size = 0;
           if (delivery->bytes) {
-            amp_append_payload(transport, delivery->bytes, delivery->size);
+            size = delivery->size;
             delivery->size = 0;
           }
-          amp_post_frame(transport, ssn_state->local_channel, TRANSFER_CODE);
+          amp_post_performative(transport, ssn_state->local_channel, TRANSFER_IDX,
+                                &performative, delivery->bytes, size);
           state->sent = true;
         }
       }
@@ -1449,14 +1765,16 @@ void amp_process_link_teardown(amp_transport_t *transport, amp_endpoint_t *endpo
     amp_session_state_t *ssn_state = amp_session_state(transport, session);
     amp_link_state_t *state = amp_link_state(ssn_state, link);
     if (endpoint->local_state == CLOSED && (int32_t) state->local_handle >= 0) {
-      amp_init_frame(transport);
-      amp_field(transport, DETACH_HANDLE, amp_value("I", state->local_handle));
-      amp_field(transport, DETACH_CLOSED, amp_boolean(true));
+      amp_performative_t performative = {{0}};
+      amp_detach_fields_t *detach = &performative.detach;
+      amp_set_field(detach, DETACH_HANDLE, handle, state->local_handle);
+      amp_set_field(detach, DETACH_CLOSED, closed, true);
       /* XXX: error
     if (condition)
       // XXX: symbol
       amp_engine_field(eng, DETACH_ERROR, amp_value("B([zS])", ERROR_CODE, condition, description)); */
-      amp_post_frame(transport, ssn_state->local_channel, DETACH_CODE);
+      amp_post_performative(transport, ssn_state->local_channel, DETACH_IDX, &performative,
+                            NULL, 0);
       state->local_handle = -2;
     }
   }
@@ -1470,11 +1788,11 @@ void amp_process_ssn_teardown(amp_transport_t *transport, amp_endpoint_t *endpoi
     amp_session_state_t *state = amp_session_state(transport, session);
     if (endpoint->local_state == CLOSED && (int16_t) state->local_channel >= 0)
     {
-      amp_init_frame(transport);
+      amp_performative_t performative = {{0}};
       /*if (condition)
       // XXX: symbol
       amp_engine_field(eng, DETACH_ERROR, amp_value("B([zS])", ERROR_CODE, condition, description));*/
-      amp_post_frame(transport, state->local_channel, END_CODE);
+      amp_post_performative(transport, state->local_channel, END_IDX, &performative, NULL, 0);
       state->local_channel = -2;
     }
   }
@@ -1485,11 +1803,11 @@ void amp_process_conn_teardown(amp_transport_t *transport, amp_endpoint_t *endpo
   if (endpoint->type == CONNECTION)
   {
     if (endpoint->local_state == CLOSED && !transport->close_sent) {
-      amp_init_frame(transport);
+      amp_performative_t performative = {{0}};
       /*if (condition)
       // XXX: symbol
       amp_field(eng, CLOSE_ERROR, amp_value("B([zS])", ERROR_CODE, condition, description));*/
-      amp_post_frame(transport, 0, CLOSE_CODE);
+      amp_post_performative(transport, 0, CLOSE_IDX, &performative, NULL, 0);
       transport->close_sent = true;
     }
   }
@@ -1534,6 +1852,23 @@ void amp_process(amp_transport_t *transport)
 }
 
 ssize_t amp_output(amp_transport_t *transport, char *bytes, size_t size)
+{
+  struct iovec iov[2];
+  int count = amp_output_iov(transport, iov, 2);
+  if (count < 0) return count;
+
+  size_t n = 0;
+  for (int i = 0; i < count && n < size; i++) {
+    size_t len = iov[i].iov_len < size - n ? iov[i].iov_len : size - n;
+    memcpy(bytes + n, iov[i].iov_base, len);
+    n += len;
+  }
+  amp_output_consume(transport, n);
+  // XXX: need to check endpoint for errors
+  return n;
+}
+
+int amp_output_iov(amp_transport_t *transport, struct iovec *iov, int iovcnt)
 {
   amp_process(transport);
 
@@ -1541,12 +1876,41 @@ ssize_t amp_output(amp_transport_t *transport, char *bytes, size_t size)
     return EOS;
   }
 
-  int n = transport->available < size ? transport->available : size;
-  memmove(bytes, transport->output, n);
-  memmove(transport->output, transport->output + n, transport->available - n);
+  if (!transport->available || iovcnt < 1) {
+    return 0;
+  }
+
+  iov[0].iov_base = transport->output + transport->head;
+  iov[0].iov_len = (transport->wrap ? transport->wrap : transport->tail) - transport->head;
+  if (!transport->wrap || iovcnt < 2)
+    return 1;
+  iov[1].iov_base = transport->output;
+  iov[1].iov_len = transport->tail;
+  return 2;
+}
+
+void amp_output_consume(amp_transport_t *transport, size_t n)
+{
+  if (n > transport->available) n = transport->available;
   transport->available -= n;
-  // XXX: need to check endpoint for errors
-  return n;
+  transport->consumed += n;
+  while (transport->retired_head && transport->retired_head->until <= transport->consumed) {
+    amp_retired_t *retired = transport->retired_head;
+    LL_POP(transport->retired_head, transport->retired_tail);
+    free(retired->output);
+    free(retired);
+  }
+  if (transport->wrap && n >= transport->wrap - transport->head) {
+    n -= transport->wrap - transport->head;
+    transport->head = 0;
+    transport->wrap = 0;
+  }
+  transport->head += n;
+  // an empty ring starts over from the front
+  if (!transport->available) {
+    transport->head = 0;
+    transport->tail = 0;
+  }
 }
 
 ssize_t amp_send(amp_sender_t *sender, const char *bytes, size_t n)
@@ -1569,8 +1933,10 @@ ssize_t amp_recv(amp_receiver_t *receiver, char *bytes, size_t n)
     if (delivery->size) {
       size_t size = n > delivery->size ? delivery->size : n;
       memmove(bytes, delivery->bytes, size);
-      memmove(bytes, bytes + size, delivery->size - size);
+      memmove(delivery->bytes, delivery->bytes + size, delivery->size - size);
       delivery->size -= size;
+      amp_transport_t *transport = link->session->connection->transport;
+      if (transport) transport->incoming -= size;
       return size;
     } else {
       return EOM;
@@ -1587,9 +1953,94 @@ void amp_flow(amp_receiver_t *receiver, int credits)
   amp_modified(receiver->link.session->connection, &receiver->link.endpoint);
 }
 
-time_t amp_tick(amp_transport_t *engine, time_t now)
+void amp_set_max_frame(amp_transport_t *transport, uint32_t size)
+{
+  // XXX: can't change what we advertised
+  if (!transport->open_sent)
+    transport->max_frame = size;
+}
+
+uint32_t amp_get_max_frame(amp_transport_t *transport)
+{
+  return transport->max_frame;
+}
+
+uint32_t amp_get_remote_max_frame(amp_transport_t *transport)
+{
+  return transport->remote_max_frame;
+}
+
+void amp_set_idle_timeout(amp_transport_t *transport, uint32_t timeout)
+{
+  // XXX: can't change what we advertised
+  if (!transport->open_sent)
+    transport->idle_timeout = timeout;
+}
+
+uint32_t amp_get_idle_timeout(amp_transport_t *transport)
 {
-  return 0;
+  return transport->idle_timeout;
+}
+
+uint32_t amp_get_remote_idle_timeout(amp_transport_t *transport)
+{
+  return transport->remote_idle_timeout;
+}
+
+size_t amp_buffered(amp_transport_t *transport)
+{
+  return transport->incoming + transport->available;
+}
+
+// rather than taking the time on every frame, input and output are
+// noticed by the frame counts having moved since the last tick. Input
+// is taken to have come as late and output to have gone out as early
+// as they could have, so neither errs towards giving up on the peer or
+// towards the peer giving up on us.
+time_t amp_tick(amp_transport_t *transport, time_t now)
+{
+  if (transport->endpoint.local_state == CLOSED) return 0;
+
+  time_t since = transport->last_tick ? transport->last_tick : now;
+  transport->last_tick = now;
+  if (!transport->last_in || transport->frames_in != transport->ticked_in) {
+    transport->ticked_in = transport->frames_in;
+    transport->last_in = now;
+  }
+  if (!transport->last_out || transport->frames_out != transport->ticked_out) {
+    transport->ticked_out = transport->frames_out;
+    transport->last_out = since;
+  }
+
+  time_t deadline = 0;
+  if (transport->idle_timeout) {
+    time_t expiry = transport->last_in + transport->idle_timeout;
+    if (now >= expiry) {
+      amp_do_error(transport, "amqp:resource-limit-exceeded",
+                   "local-idle-timeout expired");
+      transport->connection->dirty = true;
+      return 0;
+    }
+    deadline = expiry;
+  }
+
+  if (transport->remote_idle_timeout && !transport->close_sent) {
+    time_t interval = transport->remote_idle_timeout/2;
+    time_t keepalive = transport->last_out + interval;
+    if (now >= keepalive) {
+      // nothing may go out ahead of our OPEN
+      if (transport->open_sent) {
+        amp_post_empty_frame(transport);
+        transport->connection->dirty = true;
+      }
+      transport->ticked_out = transport->frames_out;
+      transport->last_out = now;
+      keepalive = now + interval;
+    }
+    if (!deadline || keepalive < deadline) deadline = keepalive;
+  }
+
+  return deadline;
 }
 
 amp_link_t *amp_link(amp_delivery_t *delivery)
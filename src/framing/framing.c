@@ -45,6 +45,14 @@ size_t amp_read_frame(amp_frame_t *frame, char *bytes, size_t available)
   return 0;
 }
 
+void amp_write_frame_header(char *bytes, size_t size, uint8_t type, uint16_t channel)
+{
+  *((uint32_t *) bytes) = ntohl(size);
+  bytes[4] = AMQP_HEADER_SIZE/4;
+  bytes[5] = type;
+  *((uint16_t *) (bytes + 6)) = ntohs(channel);
+}
+
 size_t amp_write_frame(char *bytes, size_t available, amp_frame_t frame)
 {
   size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
@@ -0,0 +1,1537 @@
+/* generated */
+#include <amp/codec.h>
+#include "protocol.h"
+
+// fields read past the count stay absent, items past the fields
+// are skipped
+#define READ(FIELD, READER)                     \
+  if (count > (FIELD)) {                        \
+    if ((e = (READER)) < 0) return e;           \
+    if (!e) fields->present |= 1u << (FIELD);   \
+  }
+
+#define WRITE(FIELD, WRITER)                             \
+  if (count > (FIELD) && (amp_present(fields, FIELD) ?   \
+                          (WRITER) :                     \
+                          amp_write_null(pos, limit)))   \
+    return -1;
+
+#define SIZE(FIELD, SIZE) \
+  if (amp_present(fields, FIELD)) size += (SIZE);
+
+// up to the last field present, the rest are left off
+static size_t amp_field_count(uint32_t present)
+{
+  size_t count = 0;
+  while (count < 32 && present >> count) count++;
+  return count;
+}
+
+static bool amp_symbol_is(const char *sym, size_t size, const char *name)
+{
+  return size == strlen(name) && !memcmp(sym, name, size);
+}
+
+static int amp_read_open_list(char **pos, char *limit, amp_open_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_open_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(OPEN_CONTAINER_ID, amp_read_utf8(pos, end, &fields->container_id.size, &fields->container_id.start));
+  READ(OPEN_HOSTNAME, amp_read_utf8(pos, end, &fields->hostname.size, &fields->hostname.start));
+  READ(OPEN_MAX_FRAME_SIZE, amp_read_uint(pos, end, &fields->max_frame_size));
+  READ(OPEN_CHANNEL_MAX, amp_read_ushort(pos, end, &fields->channel_max));
+  READ(OPEN_IDLE_TIME_OUT, amp_read_uint(pos, end, &fields->idle_time_out));
+  READ(OPEN_OUTGOING_LOCALES, amp_read_raw(pos, end, &fields->outgoing_locales.size, &fields->outgoing_locales.start));
+  READ(OPEN_INCOMING_LOCALES, amp_read_raw(pos, end, &fields->incoming_locales.size, &fields->incoming_locales.start));
+  READ(OPEN_OFFERED_CAPABILITIES, amp_read_raw(pos, end, &fields->offered_capabilities.size, &fields->offered_capabilities.start));
+  READ(OPEN_DESIRED_CAPABILITIES, amp_read_raw(pos, end, &fields->desired_capabilities.size, &fields->desired_capabilities.start));
+  READ(OPEN_PROPERTIES, amp_read_raw(pos, end, &fields->properties.size, &fields->properties.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_open(char **pos, char *limit, amp_open_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, OPEN_SYM) : code != OPEN_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_open_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_open(char **pos, char *limit, const amp_open_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, OPEN_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(OPEN_CONTAINER_ID, amp_write_utf8(pos, limit, fields->container_id.size, fields->container_id.start));
+  WRITE(OPEN_HOSTNAME, amp_write_utf8(pos, limit, fields->hostname.size, fields->hostname.start));
+  WRITE(OPEN_MAX_FRAME_SIZE, amp_write_uint(pos, limit, fields->max_frame_size));
+  WRITE(OPEN_CHANNEL_MAX, amp_write_ushort(pos, limit, fields->channel_max));
+  WRITE(OPEN_IDLE_TIME_OUT, amp_write_uint(pos, limit, fields->idle_time_out));
+  WRITE(OPEN_OUTGOING_LOCALES, amp_write_raw(pos, limit, fields->outgoing_locales.size, fields->outgoing_locales.start));
+  WRITE(OPEN_INCOMING_LOCALES, amp_write_raw(pos, limit, fields->incoming_locales.size, fields->incoming_locales.start));
+  WRITE(OPEN_OFFERED_CAPABILITIES, amp_write_raw(pos, limit, fields->offered_capabilities.size, fields->offered_capabilities.start));
+  WRITE(OPEN_DESIRED_CAPABILITIES, amp_write_raw(pos, limit, fields->desired_capabilities.size, fields->desired_capabilities.start));
+  WRITE(OPEN_PROPERTIES, amp_write_raw(pos, limit, fields->properties.size, fields->properties.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_open(const amp_open_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(OPEN_CONTAINER_ID, 4 + fields->container_id.size);
+  SIZE(OPEN_HOSTNAME, 4 + fields->hostname.size);
+  SIZE(OPEN_MAX_FRAME_SIZE, 4);
+  SIZE(OPEN_CHANNEL_MAX, 2);
+  SIZE(OPEN_IDLE_TIME_OUT, 4);
+  SIZE(OPEN_OUTGOING_LOCALES, fields->outgoing_locales.size - 1);
+  SIZE(OPEN_INCOMING_LOCALES, fields->incoming_locales.size - 1);
+  SIZE(OPEN_OFFERED_CAPABILITIES, fields->offered_capabilities.size - 1);
+  SIZE(OPEN_DESIRED_CAPABILITIES, fields->desired_capabilities.size - 1);
+  SIZE(OPEN_PROPERTIES, fields->properties.size - 1);
+  return size;
+}
+
+static int amp_read_begin_list(char **pos, char *limit, amp_begin_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_begin_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(BEGIN_REMOTE_CHANNEL, amp_read_ushort(pos, end, &fields->remote_channel));
+  READ(BEGIN_NEXT_OUTGOING_ID, amp_read_uint(pos, end, &fields->next_outgoing_id));
+  READ(BEGIN_INCOMING_WINDOW, amp_read_uint(pos, end, &fields->incoming_window));
+  READ(BEGIN_OUTGOING_WINDOW, amp_read_uint(pos, end, &fields->outgoing_window));
+  READ(BEGIN_HANDLE_MAX, amp_read_uint(pos, end, &fields->handle_max));
+  READ(BEGIN_OFFERED_CAPABILITIES, amp_read_raw(pos, end, &fields->offered_capabilities.size, &fields->offered_capabilities.start));
+  READ(BEGIN_DESIRED_CAPABILITIES, amp_read_raw(pos, end, &fields->desired_capabilities.size, &fields->desired_capabilities.start));
+  READ(BEGIN_PROPERTIES, amp_read_raw(pos, end, &fields->properties.size, &fields->properties.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_begin(char **pos, char *limit, amp_begin_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, BEGIN_SYM) : code != BEGIN_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_begin_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_begin(char **pos, char *limit, const amp_begin_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, BEGIN_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(BEGIN_REMOTE_CHANNEL, amp_write_ushort(pos, limit, fields->remote_channel));
+  WRITE(BEGIN_NEXT_OUTGOING_ID, amp_write_uint(pos, limit, fields->next_outgoing_id));
+  WRITE(BEGIN_INCOMING_WINDOW, amp_write_uint(pos, limit, fields->incoming_window));
+  WRITE(BEGIN_OUTGOING_WINDOW, amp_write_uint(pos, limit, fields->outgoing_window));
+  WRITE(BEGIN_HANDLE_MAX, amp_write_uint(pos, limit, fields->handle_max));
+  WRITE(BEGIN_OFFERED_CAPABILITIES, amp_write_raw(pos, limit, fields->offered_capabilities.size, fields->offered_capabilities.start));
+  WRITE(BEGIN_DESIRED_CAPABILITIES, amp_write_raw(pos, limit, fields->desired_capabilities.size, fields->desired_capabilities.start));
+  WRITE(BEGIN_PROPERTIES, amp_write_raw(pos, limit, fields->properties.size, fields->properties.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_begin(const amp_begin_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(BEGIN_REMOTE_CHANNEL, 2);
+  SIZE(BEGIN_NEXT_OUTGOING_ID, 4);
+  SIZE(BEGIN_INCOMING_WINDOW, 4);
+  SIZE(BEGIN_OUTGOING_WINDOW, 4);
+  SIZE(BEGIN_HANDLE_MAX, 4);
+  SIZE(BEGIN_OFFERED_CAPABILITIES, fields->offered_capabilities.size - 1);
+  SIZE(BEGIN_DESIRED_CAPABILITIES, fields->desired_capabilities.size - 1);
+  SIZE(BEGIN_PROPERTIES, fields->properties.size - 1);
+  return size;
+}
+
+static int amp_read_attach_list(char **pos, char *limit, amp_attach_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_attach_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(ATTACH_NAME, amp_read_utf8(pos, end, &fields->name.size, &fields->name.start));
+  READ(ATTACH_HANDLE, amp_read_uint(pos, end, &fields->handle));
+  READ(ATTACH_ROLE, amp_read_boolean(pos, end, &fields->role));
+  READ(ATTACH_SND_SETTLE_MODE, amp_read_ubyte(pos, end, &fields->snd_settle_mode));
+  READ(ATTACH_RCV_SETTLE_MODE, amp_read_ubyte(pos, end, &fields->rcv_settle_mode));
+  READ(ATTACH_SOURCE, amp_read_raw(pos, end, &fields->source.size, &fields->source.start));
+  READ(ATTACH_TARGET, amp_read_raw(pos, end, &fields->target.size, &fields->target.start));
+  READ(ATTACH_UNSETTLED, amp_read_raw(pos, end, &fields->unsettled.size, &fields->unsettled.start));
+  READ(ATTACH_INCOMPLETE_UNSETTLED, amp_read_boolean(pos, end, &fields->incomplete_unsettled));
+  READ(ATTACH_INITIAL_DELIVERY_COUNT, amp_read_uint(pos, end, &fields->initial_delivery_count));
+  READ(ATTACH_MAX_MESSAGE_SIZE, amp_read_ulong(pos, end, &fields->max_message_size));
+  READ(ATTACH_OFFERED_CAPABILITIES, amp_read_raw(pos, end, &fields->offered_capabilities.size, &fields->offered_capabilities.start));
+  READ(ATTACH_DESIRED_CAPABILITIES, amp_read_raw(pos, end, &fields->desired_capabilities.size, &fields->desired_capabilities.start));
+  READ(ATTACH_PROPERTIES, amp_read_raw(pos, end, &fields->properties.size, &fields->properties.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_attach(char **pos, char *limit, amp_attach_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, ATTACH_SYM) : code != ATTACH_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_attach_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_attach(char **pos, char *limit, const amp_attach_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, ATTACH_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(ATTACH_NAME, amp_write_utf8(pos, limit, fields->name.size, fields->name.start));
+  WRITE(ATTACH_HANDLE, amp_write_uint(pos, limit, fields->handle));
+  WRITE(ATTACH_ROLE, amp_write_boolean(pos, limit, fields->role));
+  WRITE(ATTACH_SND_SETTLE_MODE, amp_write_ubyte(pos, limit, fields->snd_settle_mode));
+  WRITE(ATTACH_RCV_SETTLE_MODE, amp_write_ubyte(pos, limit, fields->rcv_settle_mode));
+  WRITE(ATTACH_SOURCE, amp_write_raw(pos, limit, fields->source.size, fields->source.start));
+  WRITE(ATTACH_TARGET, amp_write_raw(pos, limit, fields->target.size, fields->target.start));
+  WRITE(ATTACH_UNSETTLED, amp_write_raw(pos, limit, fields->unsettled.size, fields->unsettled.start));
+  WRITE(ATTACH_INCOMPLETE_UNSETTLED, amp_write_boolean(pos, limit, fields->incomplete_unsettled));
+  WRITE(ATTACH_INITIAL_DELIVERY_COUNT, amp_write_uint(pos, limit, fields->initial_delivery_count));
+  WRITE(ATTACH_MAX_MESSAGE_SIZE, amp_write_ulong(pos, limit, fields->max_message_size));
+  WRITE(ATTACH_OFFERED_CAPABILITIES, amp_write_raw(pos, limit, fields->offered_capabilities.size, fields->offered_capabilities.start));
+  WRITE(ATTACH_DESIRED_CAPABILITIES, amp_write_raw(pos, limit, fields->desired_capabilities.size, fields->desired_capabilities.start));
+  WRITE(ATTACH_PROPERTIES, amp_write_raw(pos, limit, fields->properties.size, fields->properties.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_attach(const amp_attach_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(ATTACH_NAME, 4 + fields->name.size);
+  SIZE(ATTACH_HANDLE, 4);
+  SIZE(ATTACH_ROLE, 1);
+  SIZE(ATTACH_SND_SETTLE_MODE, 1);
+  SIZE(ATTACH_RCV_SETTLE_MODE, 1);
+  SIZE(ATTACH_SOURCE, fields->source.size - 1);
+  SIZE(ATTACH_TARGET, fields->target.size - 1);
+  SIZE(ATTACH_UNSETTLED, fields->unsettled.size - 1);
+  SIZE(ATTACH_INCOMPLETE_UNSETTLED, 1);
+  SIZE(ATTACH_INITIAL_DELIVERY_COUNT, 4);
+  SIZE(ATTACH_MAX_MESSAGE_SIZE, 8);
+  SIZE(ATTACH_OFFERED_CAPABILITIES, fields->offered_capabilities.size - 1);
+  SIZE(ATTACH_DESIRED_CAPABILITIES, fields->desired_capabilities.size - 1);
+  SIZE(ATTACH_PROPERTIES, fields->properties.size - 1);
+  return size;
+}
+
+static int amp_read_flow_list(char **pos, char *limit, amp_flow_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_flow_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(FLOW_NEXT_INCOMING_ID, amp_read_uint(pos, end, &fields->next_incoming_id));
+  READ(FLOW_INCOMING_WINDOW, amp_read_uint(pos, end, &fields->incoming_window));
+  READ(FLOW_NEXT_OUTGOING_ID, amp_read_uint(pos, end, &fields->next_outgoing_id));
+  READ(FLOW_OUTGOING_WINDOW, amp_read_uint(pos, end, &fields->outgoing_window));
+  READ(FLOW_HANDLE, amp_read_uint(pos, end, &fields->handle));
+  READ(FLOW_DELIVERY_COUNT, amp_read_uint(pos, end, &fields->delivery_count));
+  READ(FLOW_LINK_CREDIT, amp_read_uint(pos, end, &fields->link_credit));
+  READ(FLOW_AVAILABLE, amp_read_uint(pos, end, &fields->available));
+  READ(FLOW_DRAIN, amp_read_boolean(pos, end, &fields->drain));
+  READ(FLOW_ECHO, amp_read_boolean(pos, end, &fields->echo));
+  READ(FLOW_PROPERTIES, amp_read_raw(pos, end, &fields->properties.size, &fields->properties.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_flow(char **pos, char *limit, amp_flow_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, FLOW_SYM) : code != FLOW_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_flow_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_flow(char **pos, char *limit, const amp_flow_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, FLOW_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(FLOW_NEXT_INCOMING_ID, amp_write_uint(pos, limit, fields->next_incoming_id));
+  WRITE(FLOW_INCOMING_WINDOW, amp_write_uint(pos, limit, fields->incoming_window));
+  WRITE(FLOW_NEXT_OUTGOING_ID, amp_write_uint(pos, limit, fields->next_outgoing_id));
+  WRITE(FLOW_OUTGOING_WINDOW, amp_write_uint(pos, limit, fields->outgoing_window));
+  WRITE(FLOW_HANDLE, amp_write_uint(pos, limit, fields->handle));
+  WRITE(FLOW_DELIVERY_COUNT, amp_write_uint(pos, limit, fields->delivery_count));
+  WRITE(FLOW_LINK_CREDIT, amp_write_uint(pos, limit, fields->link_credit));
+  WRITE(FLOW_AVAILABLE, amp_write_uint(pos, limit, fields->available));
+  WRITE(FLOW_DRAIN, amp_write_boolean(pos, limit, fields->drain));
+  WRITE(FLOW_ECHO, amp_write_boolean(pos, limit, fields->echo));
+  WRITE(FLOW_PROPERTIES, amp_write_raw(pos, limit, fields->properties.size, fields->properties.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_flow(const amp_flow_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(FLOW_NEXT_INCOMING_ID, 4);
+  SIZE(FLOW_INCOMING_WINDOW, 4);
+  SIZE(FLOW_NEXT_OUTGOING_ID, 4);
+  SIZE(FLOW_OUTGOING_WINDOW, 4);
+  SIZE(FLOW_HANDLE, 4);
+  SIZE(FLOW_DELIVERY_COUNT, 4);
+  SIZE(FLOW_LINK_CREDIT, 4);
+  SIZE(FLOW_AVAILABLE, 4);
+  SIZE(FLOW_DRAIN, 1);
+  SIZE(FLOW_ECHO, 1);
+  SIZE(FLOW_PROPERTIES, fields->properties.size - 1);
+  return size;
+}
+
+static int amp_read_transfer_list(char **pos, char *limit, amp_transfer_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_transfer_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(TRANSFER_HANDLE, amp_read_uint(pos, end, &fields->handle));
+  READ(TRANSFER_DELIVERY_ID, amp_read_uint(pos, end, &fields->delivery_id));
+  READ(TRANSFER_DELIVERY_TAG, amp_read_binary(pos, end, &fields->delivery_tag.size, &fields->delivery_tag.start));
+  READ(TRANSFER_MESSAGE_FORMAT, amp_read_uint(pos, end, &fields->message_format));
+  READ(TRANSFER_SETTLED, amp_read_boolean(pos, end, &fields->settled));
+  READ(TRANSFER_MORE, amp_read_boolean(pos, end, &fields->more));
+  READ(TRANSFER_RCV_SETTLE_MODE, amp_read_ubyte(pos, end, &fields->rcv_settle_mode));
+  READ(TRANSFER_STATE, amp_read_raw(pos, end, &fields->state.size, &fields->state.start));
+  READ(TRANSFER_RESUME, amp_read_boolean(pos, end, &fields->resume));
+  READ(TRANSFER_ABORTED, amp_read_boolean(pos, end, &fields->aborted));
+  READ(TRANSFER_BATCHABLE, amp_read_boolean(pos, end, &fields->batchable));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_transfer(char **pos, char *limit, amp_transfer_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, TRANSFER_SYM) : code != TRANSFER_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_transfer_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_transfer(char **pos, char *limit, const amp_transfer_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, TRANSFER_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(TRANSFER_HANDLE, amp_write_uint(pos, limit, fields->handle));
+  WRITE(TRANSFER_DELIVERY_ID, amp_write_uint(pos, limit, fields->delivery_id));
+  WRITE(TRANSFER_DELIVERY_TAG, amp_write_binary(pos, limit, fields->delivery_tag.size, fields->delivery_tag.start));
+  WRITE(TRANSFER_MESSAGE_FORMAT, amp_write_uint(pos, limit, fields->message_format));
+  WRITE(TRANSFER_SETTLED, amp_write_boolean(pos, limit, fields->settled));
+  WRITE(TRANSFER_MORE, amp_write_boolean(pos, limit, fields->more));
+  WRITE(TRANSFER_RCV_SETTLE_MODE, amp_write_ubyte(pos, limit, fields->rcv_settle_mode));
+  WRITE(TRANSFER_STATE, amp_write_raw(pos, limit, fields->state.size, fields->state.start));
+  WRITE(TRANSFER_RESUME, amp_write_boolean(pos, limit, fields->resume));
+  WRITE(TRANSFER_ABORTED, amp_write_boolean(pos, limit, fields->aborted));
+  WRITE(TRANSFER_BATCHABLE, amp_write_boolean(pos, limit, fields->batchable));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_transfer(const amp_transfer_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(TRANSFER_HANDLE, 4);
+  SIZE(TRANSFER_DELIVERY_ID, 4);
+  SIZE(TRANSFER_DELIVERY_TAG, 4 + fields->delivery_tag.size);
+  SIZE(TRANSFER_MESSAGE_FORMAT, 4);
+  SIZE(TRANSFER_SETTLED, 1);
+  SIZE(TRANSFER_MORE, 1);
+  SIZE(TRANSFER_RCV_SETTLE_MODE, 1);
+  SIZE(TRANSFER_STATE, fields->state.size - 1);
+  SIZE(TRANSFER_RESUME, 1);
+  SIZE(TRANSFER_ABORTED, 1);
+  SIZE(TRANSFER_BATCHABLE, 1);
+  return size;
+}
+
+static int amp_read_disposition_list(char **pos, char *limit, amp_disposition_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_disposition_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(DISPOSITION_ROLE, amp_read_boolean(pos, end, &fields->role));
+  READ(DISPOSITION_FIRST, amp_read_uint(pos, end, &fields->first));
+  READ(DISPOSITION_LAST, amp_read_uint(pos, end, &fields->last));
+  READ(DISPOSITION_SETTLED, amp_read_boolean(pos, end, &fields->settled));
+  READ(DISPOSITION_STATE, amp_read_raw(pos, end, &fields->state.size, &fields->state.start));
+  READ(DISPOSITION_BATCHABLE, amp_read_boolean(pos, end, &fields->batchable));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_disposition(char **pos, char *limit, amp_disposition_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DISPOSITION_SYM) : code != DISPOSITION_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_disposition_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_disposition(char **pos, char *limit, const amp_disposition_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DISPOSITION_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(DISPOSITION_ROLE, amp_write_boolean(pos, limit, fields->role));
+  WRITE(DISPOSITION_FIRST, amp_write_uint(pos, limit, fields->first));
+  WRITE(DISPOSITION_LAST, amp_write_uint(pos, limit, fields->last));
+  WRITE(DISPOSITION_SETTLED, amp_write_boolean(pos, limit, fields->settled));
+  WRITE(DISPOSITION_STATE, amp_write_raw(pos, limit, fields->state.size, fields->state.start));
+  WRITE(DISPOSITION_BATCHABLE, amp_write_boolean(pos, limit, fields->batchable));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_disposition(const amp_disposition_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(DISPOSITION_ROLE, 1);
+  SIZE(DISPOSITION_FIRST, 4);
+  SIZE(DISPOSITION_LAST, 4);
+  SIZE(DISPOSITION_SETTLED, 1);
+  SIZE(DISPOSITION_STATE, fields->state.size - 1);
+  SIZE(DISPOSITION_BATCHABLE, 1);
+  return size;
+}
+
+static int amp_read_detach_list(char **pos, char *limit, amp_detach_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_detach_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(DETACH_HANDLE, amp_read_uint(pos, end, &fields->handle));
+  READ(DETACH_CLOSED, amp_read_boolean(pos, end, &fields->closed));
+  READ(DETACH_ERROR, amp_read_raw(pos, end, &fields->error.size, &fields->error.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_detach(char **pos, char *limit, amp_detach_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DETACH_SYM) : code != DETACH_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_detach_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_detach(char **pos, char *limit, const amp_detach_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DETACH_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(DETACH_HANDLE, amp_write_uint(pos, limit, fields->handle));
+  WRITE(DETACH_CLOSED, amp_write_boolean(pos, limit, fields->closed));
+  WRITE(DETACH_ERROR, amp_write_raw(pos, limit, fields->error.size, fields->error.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_detach(const amp_detach_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(DETACH_HANDLE, 4);
+  SIZE(DETACH_CLOSED, 1);
+  SIZE(DETACH_ERROR, fields->error.size - 1);
+  return size;
+}
+
+static int amp_read_end_list(char **pos, char *limit, amp_end_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_end_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(END_ERROR, amp_read_raw(pos, end, &fields->error.size, &fields->error.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_end(char **pos, char *limit, amp_end_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, END_SYM) : code != END_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_end_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_end(char **pos, char *limit, const amp_end_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, END_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(END_ERROR, amp_write_raw(pos, limit, fields->error.size, fields->error.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_end(const amp_end_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(END_ERROR, fields->error.size - 1);
+  return size;
+}
+
+static int amp_read_close_list(char **pos, char *limit, amp_close_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_close_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(CLOSE_ERROR, amp_read_raw(pos, end, &fields->error.size, &fields->error.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_close(char **pos, char *limit, amp_close_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, CLOSE_SYM) : code != CLOSE_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_close_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_close(char **pos, char *limit, const amp_close_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, CLOSE_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(CLOSE_ERROR, amp_write_raw(pos, limit, fields->error.size, fields->error.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_close(const amp_close_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(CLOSE_ERROR, fields->error.size - 1);
+  return size;
+}
+
+static int amp_read_error_list(char **pos, char *limit, amp_error_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_error_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(ERROR_CONDITION, amp_read_symbol(pos, end, &fields->condition.size, &fields->condition.start));
+  READ(ERROR_DESCRIPTION, amp_read_utf8(pos, end, &fields->description.size, &fields->description.start));
+  READ(ERROR_INFO, amp_read_raw(pos, end, &fields->info.size, &fields->info.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_error(char **pos, char *limit, amp_error_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, ERROR_SYM) : code != ERROR_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_error_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_error(char **pos, char *limit, const amp_error_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, ERROR_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(ERROR_CONDITION, amp_write_symbol(pos, limit, fields->condition.size, fields->condition.start));
+  WRITE(ERROR_DESCRIPTION, amp_write_utf8(pos, limit, fields->description.size, fields->description.start));
+  WRITE(ERROR_INFO, amp_write_raw(pos, limit, fields->info.size, fields->info.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_error(const amp_error_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(ERROR_CONDITION, 4 + fields->condition.size);
+  SIZE(ERROR_DESCRIPTION, 4 + fields->description.size);
+  SIZE(ERROR_INFO, fields->info.size - 1);
+  return size;
+}
+
+static int amp_read_header_list(char **pos, char *limit, amp_header_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_header_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(HEADER_DURABLE, amp_read_boolean(pos, end, &fields->durable));
+  READ(HEADER_PRIORITY, amp_read_ubyte(pos, end, &fields->priority));
+  READ(HEADER_TTL, amp_read_uint(pos, end, &fields->ttl));
+  READ(HEADER_FIRST_ACQUIRER, amp_read_boolean(pos, end, &fields->first_acquirer));
+  READ(HEADER_DELIVERY_COUNT, amp_read_uint(pos, end, &fields->delivery_count));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_header(char **pos, char *limit, amp_header_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, HEADER_SYM) : code != HEADER_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_header_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_header(char **pos, char *limit, const amp_header_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, HEADER_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(HEADER_DURABLE, amp_write_boolean(pos, limit, fields->durable));
+  WRITE(HEADER_PRIORITY, amp_write_ubyte(pos, limit, fields->priority));
+  WRITE(HEADER_TTL, amp_write_uint(pos, limit, fields->ttl));
+  WRITE(HEADER_FIRST_ACQUIRER, amp_write_boolean(pos, limit, fields->first_acquirer));
+  WRITE(HEADER_DELIVERY_COUNT, amp_write_uint(pos, limit, fields->delivery_count));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_header(const amp_header_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(HEADER_DURABLE, 1);
+  SIZE(HEADER_PRIORITY, 1);
+  SIZE(HEADER_TTL, 4);
+  SIZE(HEADER_FIRST_ACQUIRER, 1);
+  SIZE(HEADER_DELIVERY_COUNT, 4);
+  return size;
+}
+
+static int amp_read_properties_list(char **pos, char *limit, amp_properties_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_properties_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(PROPERTIES_MESSAGE_ID, amp_read_raw(pos, end, &fields->message_id.size, &fields->message_id.start));
+  READ(PROPERTIES_USER_ID, amp_read_binary(pos, end, &fields->user_id.size, &fields->user_id.start));
+  READ(PROPERTIES_TO, amp_read_raw(pos, end, &fields->to.size, &fields->to.start));
+  READ(PROPERTIES_SUBJECT, amp_read_utf8(pos, end, &fields->subject.size, &fields->subject.start));
+  READ(PROPERTIES_REPLY_TO, amp_read_raw(pos, end, &fields->reply_to.size, &fields->reply_to.start));
+  READ(PROPERTIES_CORRELATION_ID, amp_read_raw(pos, end, &fields->correlation_id.size, &fields->correlation_id.start));
+  READ(PROPERTIES_CONTENT_TYPE, amp_read_symbol(pos, end, &fields->content_type.size, &fields->content_type.start));
+  READ(PROPERTIES_CONTENT_ENCODING, amp_read_symbol(pos, end, &fields->content_encoding.size, &fields->content_encoding.start));
+  READ(PROPERTIES_ABSOLUTE_EXPIRY_TIME, amp_read_raw(pos, end, &fields->absolute_expiry_time.size, &fields->absolute_expiry_time.start));
+  READ(PROPERTIES_CREATION_TIME, amp_read_raw(pos, end, &fields->creation_time.size, &fields->creation_time.start));
+  READ(PROPERTIES_GROUP_ID, amp_read_utf8(pos, end, &fields->group_id.size, &fields->group_id.start));
+  READ(PROPERTIES_GROUP_SEQUENCE, amp_read_uint(pos, end, &fields->group_sequence));
+  READ(PROPERTIES_REPLY_TO_GROUP_ID, amp_read_utf8(pos, end, &fields->reply_to_group_id.size, &fields->reply_to_group_id.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_properties(char **pos, char *limit, amp_properties_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, PROPERTIES_SYM) : code != PROPERTIES_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_properties_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_properties(char **pos, char *limit, const amp_properties_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, PROPERTIES_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(PROPERTIES_MESSAGE_ID, amp_write_raw(pos, limit, fields->message_id.size, fields->message_id.start));
+  WRITE(PROPERTIES_USER_ID, amp_write_binary(pos, limit, fields->user_id.size, fields->user_id.start));
+  WRITE(PROPERTIES_TO, amp_write_raw(pos, limit, fields->to.size, fields->to.start));
+  WRITE(PROPERTIES_SUBJECT, amp_write_utf8(pos, limit, fields->subject.size, fields->subject.start));
+  WRITE(PROPERTIES_REPLY_TO, amp_write_raw(pos, limit, fields->reply_to.size, fields->reply_to.start));
+  WRITE(PROPERTIES_CORRELATION_ID, amp_write_raw(pos, limit, fields->correlation_id.size, fields->correlation_id.start));
+  WRITE(PROPERTIES_CONTENT_TYPE, amp_write_symbol(pos, limit, fields->content_type.size, fields->content_type.start));
+  WRITE(PROPERTIES_CONTENT_ENCODING, amp_write_symbol(pos, limit, fields->content_encoding.size, fields->content_encoding.start));
+  WRITE(PROPERTIES_ABSOLUTE_EXPIRY_TIME, amp_write_raw(pos, limit, fields->absolute_expiry_time.size, fields->absolute_expiry_time.start));
+  WRITE(PROPERTIES_CREATION_TIME, amp_write_raw(pos, limit, fields->creation_time.size, fields->creation_time.start));
+  WRITE(PROPERTIES_GROUP_ID, amp_write_utf8(pos, limit, fields->group_id.size, fields->group_id.start));
+  WRITE(PROPERTIES_GROUP_SEQUENCE, amp_write_uint(pos, limit, fields->group_sequence));
+  WRITE(PROPERTIES_REPLY_TO_GROUP_ID, amp_write_utf8(pos, limit, fields->reply_to_group_id.size, fields->reply_to_group_id.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_properties(const amp_properties_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(PROPERTIES_MESSAGE_ID, fields->message_id.size - 1);
+  SIZE(PROPERTIES_USER_ID, 4 + fields->user_id.size);
+  SIZE(PROPERTIES_TO, fields->to.size - 1);
+  SIZE(PROPERTIES_SUBJECT, 4 + fields->subject.size);
+  SIZE(PROPERTIES_REPLY_TO, fields->reply_to.size - 1);
+  SIZE(PROPERTIES_CORRELATION_ID, fields->correlation_id.size - 1);
+  SIZE(PROPERTIES_CONTENT_TYPE, 4 + fields->content_type.size);
+  SIZE(PROPERTIES_CONTENT_ENCODING, 4 + fields->content_encoding.size);
+  SIZE(PROPERTIES_ABSOLUTE_EXPIRY_TIME, fields->absolute_expiry_time.size - 1);
+  SIZE(PROPERTIES_CREATION_TIME, fields->creation_time.size - 1);
+  SIZE(PROPERTIES_GROUP_ID, 4 + fields->group_id.size);
+  SIZE(PROPERTIES_GROUP_SEQUENCE, 4);
+  SIZE(PROPERTIES_REPLY_TO_GROUP_ID, 4 + fields->reply_to_group_id.size);
+  return size;
+}
+
+static int amp_read_received_list(char **pos, char *limit, amp_received_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_received_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(RECEIVED_SECTION_NUMBER, amp_read_uint(pos, end, &fields->section_number));
+  READ(RECEIVED_SECTION_OFFSET, amp_read_ulong(pos, end, &fields->section_offset));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_received(char **pos, char *limit, amp_received_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, RECEIVED_SYM) : code != RECEIVED_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_received_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_received(char **pos, char *limit, const amp_received_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, RECEIVED_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(RECEIVED_SECTION_NUMBER, amp_write_uint(pos, limit, fields->section_number));
+  WRITE(RECEIVED_SECTION_OFFSET, amp_write_ulong(pos, limit, fields->section_offset));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_received(const amp_received_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(RECEIVED_SECTION_NUMBER, 4);
+  SIZE(RECEIVED_SECTION_OFFSET, 8);
+  return size;
+}
+
+static int amp_read_accepted_list(char **pos, char *limit, amp_accepted_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_accepted_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_accepted(char **pos, char *limit, amp_accepted_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, ACCEPTED_SYM) : code != ACCEPTED_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_accepted_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_accepted(char **pos, char *limit, const amp_accepted_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, ACCEPTED_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_accepted(const amp_accepted_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+static int amp_read_rejected_list(char **pos, char *limit, amp_rejected_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_rejected_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(REJECTED_ERROR, amp_read_raw(pos, end, &fields->error.size, &fields->error.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_rejected(char **pos, char *limit, amp_rejected_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, REJECTED_SYM) : code != REJECTED_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_rejected_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_rejected(char **pos, char *limit, const amp_rejected_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, REJECTED_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(REJECTED_ERROR, amp_write_raw(pos, limit, fields->error.size, fields->error.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_rejected(const amp_rejected_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(REJECTED_ERROR, fields->error.size - 1);
+  return size;
+}
+
+static int amp_read_released_list(char **pos, char *limit, amp_released_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_released_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_released(char **pos, char *limit, amp_released_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, RELEASED_SYM) : code != RELEASED_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_released_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_released(char **pos, char *limit, const amp_released_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, RELEASED_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_released(const amp_released_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+static int amp_read_modified_list(char **pos, char *limit, amp_modified_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_modified_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(MODIFIED_DELIVERY_FAILED, amp_read_boolean(pos, end, &fields->delivery_failed));
+  READ(MODIFIED_UNDELIVERABLE_HERE, amp_read_boolean(pos, end, &fields->undeliverable_here));
+  READ(MODIFIED_MESSAGE_ANNOTATIONS, amp_read_raw(pos, end, &fields->message_annotations.size, &fields->message_annotations.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_modified(char **pos, char *limit, amp_modified_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, MODIFIED_SYM) : code != MODIFIED_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_modified_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_modified(char **pos, char *limit, const amp_modified_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, MODIFIED_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(MODIFIED_DELIVERY_FAILED, amp_write_boolean(pos, limit, fields->delivery_failed));
+  WRITE(MODIFIED_UNDELIVERABLE_HERE, amp_write_boolean(pos, limit, fields->undeliverable_here));
+  WRITE(MODIFIED_MESSAGE_ANNOTATIONS, amp_write_raw(pos, limit, fields->message_annotations.size, fields->message_annotations.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_modified(const amp_modified_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(MODIFIED_DELIVERY_FAILED, 1);
+  SIZE(MODIFIED_UNDELIVERABLE_HERE, 1);
+  SIZE(MODIFIED_MESSAGE_ANNOTATIONS, fields->message_annotations.size - 1);
+  return size;
+}
+
+static int amp_read_source_list(char **pos, char *limit, amp_source_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_source_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(SOURCE_ADDRESS, amp_read_raw(pos, end, &fields->address.size, &fields->address.start));
+  READ(SOURCE_DURABLE, amp_read_uint(pos, end, &fields->durable));
+  READ(SOURCE_EXPIRY_POLICY, amp_read_symbol(pos, end, &fields->expiry_policy.size, &fields->expiry_policy.start));
+  READ(SOURCE_TIMEOUT, amp_read_uint(pos, end, &fields->timeout));
+  READ(SOURCE_DYNAMIC, amp_read_boolean(pos, end, &fields->dynamic));
+  READ(SOURCE_DYNAMIC_NODE_PROPERTIES, amp_read_raw(pos, end, &fields->dynamic_node_properties.size, &fields->dynamic_node_properties.start));
+  READ(SOURCE_DISTRIBUTION_MODE, amp_read_symbol(pos, end, &fields->distribution_mode.size, &fields->distribution_mode.start));
+  READ(SOURCE_FILTER, amp_read_raw(pos, end, &fields->filter.size, &fields->filter.start));
+  READ(SOURCE_DEFAULT_OUTCOME, amp_read_raw(pos, end, &fields->default_outcome.size, &fields->default_outcome.start));
+  READ(SOURCE_OUTCOMES, amp_read_raw(pos, end, &fields->outcomes.size, &fields->outcomes.start));
+  READ(SOURCE_CAPABILITIES, amp_read_raw(pos, end, &fields->capabilities.size, &fields->capabilities.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_source(char **pos, char *limit, amp_source_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, SOURCE_SYM) : code != SOURCE_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_source_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_source(char **pos, char *limit, const amp_source_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, SOURCE_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(SOURCE_ADDRESS, amp_write_raw(pos, limit, fields->address.size, fields->address.start));
+  WRITE(SOURCE_DURABLE, amp_write_uint(pos, limit, fields->durable));
+  WRITE(SOURCE_EXPIRY_POLICY, amp_write_symbol(pos, limit, fields->expiry_policy.size, fields->expiry_policy.start));
+  WRITE(SOURCE_TIMEOUT, amp_write_uint(pos, limit, fields->timeout));
+  WRITE(SOURCE_DYNAMIC, amp_write_boolean(pos, limit, fields->dynamic));
+  WRITE(SOURCE_DYNAMIC_NODE_PROPERTIES, amp_write_raw(pos, limit, fields->dynamic_node_properties.size, fields->dynamic_node_properties.start));
+  WRITE(SOURCE_DISTRIBUTION_MODE, amp_write_symbol(pos, limit, fields->distribution_mode.size, fields->distribution_mode.start));
+  WRITE(SOURCE_FILTER, amp_write_raw(pos, limit, fields->filter.size, fields->filter.start));
+  WRITE(SOURCE_DEFAULT_OUTCOME, amp_write_raw(pos, limit, fields->default_outcome.size, fields->default_outcome.start));
+  WRITE(SOURCE_OUTCOMES, amp_write_raw(pos, limit, fields->outcomes.size, fields->outcomes.start));
+  WRITE(SOURCE_CAPABILITIES, amp_write_raw(pos, limit, fields->capabilities.size, fields->capabilities.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_source(const amp_source_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(SOURCE_ADDRESS, fields->address.size - 1);
+  SIZE(SOURCE_DURABLE, 4);
+  SIZE(SOURCE_EXPIRY_POLICY, 4 + fields->expiry_policy.size);
+  SIZE(SOURCE_TIMEOUT, 4);
+  SIZE(SOURCE_DYNAMIC, 1);
+  SIZE(SOURCE_DYNAMIC_NODE_PROPERTIES, fields->dynamic_node_properties.size - 1);
+  SIZE(SOURCE_DISTRIBUTION_MODE, 4 + fields->distribution_mode.size);
+  SIZE(SOURCE_FILTER, fields->filter.size - 1);
+  SIZE(SOURCE_DEFAULT_OUTCOME, fields->default_outcome.size - 1);
+  SIZE(SOURCE_OUTCOMES, fields->outcomes.size - 1);
+  SIZE(SOURCE_CAPABILITIES, fields->capabilities.size - 1);
+  return size;
+}
+
+static int amp_read_target_list(char **pos, char *limit, amp_target_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  int e;
+  *fields = (amp_target_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  READ(TARGET_ADDRESS, amp_read_raw(pos, end, &fields->address.size, &fields->address.start));
+  READ(TARGET_DURABLE, amp_read_uint(pos, end, &fields->durable));
+  READ(TARGET_EXPIRY_POLICY, amp_read_symbol(pos, end, &fields->expiry_policy.size, &fields->expiry_policy.start));
+  READ(TARGET_TIMEOUT, amp_read_uint(pos, end, &fields->timeout));
+  READ(TARGET_DYNAMIC, amp_read_boolean(pos, end, &fields->dynamic));
+  READ(TARGET_DYNAMIC_NODE_PROPERTIES, amp_read_raw(pos, end, &fields->dynamic_node_properties.size, &fields->dynamic_node_properties.start));
+  READ(TARGET_CAPABILITIES, amp_read_raw(pos, end, &fields->capabilities.size, &fields->capabilities.start));
+  *pos = end;
+  return 0;
+}
+
+int amp_read_target(char **pos, char *limit, amp_target_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, TARGET_SYM) : code != TARGET_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_target_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_target(char **pos, char *limit, const amp_target_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, TARGET_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  WRITE(TARGET_ADDRESS, amp_write_raw(pos, limit, fields->address.size, fields->address.start));
+  WRITE(TARGET_DURABLE, amp_write_uint(pos, limit, fields->durable));
+  WRITE(TARGET_EXPIRY_POLICY, amp_write_symbol(pos, limit, fields->expiry_policy.size, fields->expiry_policy.start));
+  WRITE(TARGET_TIMEOUT, amp_write_uint(pos, limit, fields->timeout));
+  WRITE(TARGET_DYNAMIC, amp_write_boolean(pos, limit, fields->dynamic));
+  WRITE(TARGET_DYNAMIC_NODE_PROPERTIES, amp_write_raw(pos, limit, fields->dynamic_node_properties.size, fields->dynamic_node_properties.start));
+  WRITE(TARGET_CAPABILITIES, amp_write_raw(pos, limit, fields->capabilities.size, fields->capabilities.start));
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_target(const amp_target_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  SIZE(TARGET_ADDRESS, fields->address.size - 1);
+  SIZE(TARGET_DURABLE, 4);
+  SIZE(TARGET_EXPIRY_POLICY, 4 + fields->expiry_policy.size);
+  SIZE(TARGET_TIMEOUT, 4);
+  SIZE(TARGET_DYNAMIC, 1);
+  SIZE(TARGET_DYNAMIC_NODE_PROPERTIES, fields->dynamic_node_properties.size - 1);
+  SIZE(TARGET_CAPABILITIES, fields->capabilities.size - 1);
+  return size;
+}
+
+static int amp_read_delete_on_close_list(char **pos, char *limit, amp_delete_on_close_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_delete_on_close_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_delete_on_close(char **pos, char *limit, amp_delete_on_close_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DELETE_ON_CLOSE_SYM) : code != DELETE_ON_CLOSE_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_delete_on_close_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_delete_on_close(char **pos, char *limit, const amp_delete_on_close_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DELETE_ON_CLOSE_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_delete_on_close(const amp_delete_on_close_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+static int amp_read_delete_on_no_links_list(char **pos, char *limit, amp_delete_on_no_links_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_delete_on_no_links_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_delete_on_no_links(char **pos, char *limit, amp_delete_on_no_links_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DELETE_ON_NO_LINKS_SYM) : code != DELETE_ON_NO_LINKS_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_delete_on_no_links_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_delete_on_no_links(char **pos, char *limit, const amp_delete_on_no_links_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DELETE_ON_NO_LINKS_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_delete_on_no_links(const amp_delete_on_no_links_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+static int amp_read_delete_on_no_messages_list(char **pos, char *limit, amp_delete_on_no_messages_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_delete_on_no_messages_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_delete_on_no_messages(char **pos, char *limit, amp_delete_on_no_messages_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DELETE_ON_NO_MESSAGES_SYM) : code != DELETE_ON_NO_MESSAGES_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_delete_on_no_messages_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_delete_on_no_messages(char **pos, char *limit, const amp_delete_on_no_messages_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DELETE_ON_NO_MESSAGES_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_delete_on_no_messages(const amp_delete_on_no_messages_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+static int amp_read_delete_on_no_links_or_messages_list(char **pos, char *limit, amp_delete_on_no_links_or_messages_fields_t *fields)
+{
+  size_t count;
+  char *end;
+  *fields = (amp_delete_on_no_links_or_messages_fields_t) {0};
+  if (amp_read_list(pos, limit, &count, &end)) return -1;
+  *pos = end;
+  return 0;
+}
+
+int amp_read_delete_on_no_links_or_messages(char **pos, char *limit, amp_delete_on_no_links_or_messages_fields_t *fields)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *sym;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);
+  if (e < 0 || (e ? !amp_symbol_is(sym, size, DELETE_ON_NO_LINKS_OR_MESSAGES_SYM) : code != DELETE_ON_NO_LINKS_OR_MESSAGES_CODE)) {
+    *pos = start;
+    return -1;
+  }
+  if (amp_read_delete_on_no_links_or_messages_list(pos, limit, fields)) {
+    *pos = start;
+    return -1;
+  }
+  return 0;
+}
+
+int amp_write_delete_on_no_links_or_messages(char **pos, char *limit, const amp_delete_on_no_links_or_messages_fields_t *fields)
+{
+  size_t count = amp_field_count(fields->present);
+  char *start;
+  if (amp_write_descriptor(pos, limit) ||
+      amp_write_ulong(pos, limit, DELETE_ON_NO_LINKS_OR_MESSAGES_CODE) ||
+      amp_write_start(pos, limit, &start))
+    return -1;
+  return amp_write_list(pos, limit, start, count);
+}
+
+size_t amp_sizeof_delete_on_no_links_or_messages(const amp_delete_on_no_links_or_messages_fields_t *fields)
+{
+  // the descriptor and list head, then a byte for each field
+  size_t size = 19 + amp_field_count(fields->present);
+  return size;
+}
+
+int amp_read_performative(char **pos, char *limit, int *idx,
+                          amp_performative_t *performative)
+{
+  char *start = *pos;
+  uint64_t code;
+  size_t size;
+  char *bytes;
+  int e = amp_read_descriptor(pos, limit, &code, &size, &bytes);
+  if (e < 0) return e;
+  *idx = e ? amp_performative_sym(bytes, size) : amp_performative_code(code);
+  switch (*idx) {
+  case OPEN_IDX:
+    e = amp_read_open_list(pos, limit, &performative->open);
+    break;
+  case BEGIN_IDX:
+    e = amp_read_begin_list(pos, limit, &performative->begin);
+    break;
+  case ATTACH_IDX:
+    e = amp_read_attach_list(pos, limit, &performative->attach);
+    break;
+  case FLOW_IDX:
+    e = amp_read_flow_list(pos, limit, &performative->flow);
+    break;
+  case TRANSFER_IDX:
+    e = amp_read_transfer_list(pos, limit, &performative->transfer);
+    break;
+  case DISPOSITION_IDX:
+    e = amp_read_disposition_list(pos, limit, &performative->disposition);
+    break;
+  case DETACH_IDX:
+    e = amp_read_detach_list(pos, limit, &performative->detach);
+    break;
+  case END_IDX:
+    e = amp_read_end_list(pos, limit, &performative->end);
+    break;
+  case CLOSE_IDX:
+    e = amp_read_close_list(pos, limit, &performative->close);
+    break;
+  default:
+    e = amp_read_raw(pos, limit, &size, &bytes);
+    break;
+  }
+  if (e < 0) *pos = start;
+  return e < 0 ? e : 0;
+}
+
+int amp_write_performative(char **pos, char *limit, int idx,
+                           const amp_performative_t *performative)
+{
+  switch (idx) {
+  case OPEN_IDX:
+    return amp_write_open(pos, limit, &performative->open);
+  case BEGIN_IDX:
+    return amp_write_begin(pos, limit, &performative->begin);
+  case ATTACH_IDX:
+    return amp_write_attach(pos, limit, &performative->attach);
+  case FLOW_IDX:
+    return amp_write_flow(pos, limit, &performative->flow);
+  case TRANSFER_IDX:
+    return amp_write_transfer(pos, limit, &performative->transfer);
+  case DISPOSITION_IDX:
+    return amp_write_disposition(pos, limit, &performative->disposition);
+  case DETACH_IDX:
+    return amp_write_detach(pos, limit, &performative->detach);
+  case END_IDX:
+    return amp_write_end(pos, limit, &performative->end);
+  case CLOSE_IDX:
+    return amp_write_close(pos, limit, &performative->close);
+  default:
+    return -1;
+  }
+}
+
+size_t amp_sizeof_performative(int idx, const amp_performative_t *performative)
+{
+  switch (idx) {
+  case OPEN_IDX:
+    return amp_sizeof_open(&performative->open);
+  case BEGIN_IDX:
+    return amp_sizeof_begin(&performative->begin);
+  case ATTACH_IDX:
+    return amp_sizeof_attach(&performative->attach);
+  case FLOW_IDX:
+    return amp_sizeof_flow(&performative->flow);
+  case TRANSFER_IDX:
+    return amp_sizeof_transfer(&performative->transfer);
+  case DISPOSITION_IDX:
+    return amp_sizeof_disposition(&performative->disposition);
+  case DETACH_IDX:
+    return amp_sizeof_detach(&performative->detach);
+  case END_IDX:
+    return amp_sizeof_end(&performative->end);
+  case CLOSE_IDX:
+    return amp_sizeof_close(&performative->close);
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/python
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+from protocol import *
+
+print "/* generated */"
+print "#include <amp/codec.h>"
+print "#include \"protocol.h\""
+print
+print "// fields read past the count stay absent, items past the fields"
+print "// are skipped"
+print "#define READ(FIELD, READER)                     \\"
+print "  if (count > (FIELD)) {                        \\"
+print "    if ((e = (READER)) < 0) return e;           \\"
+print "    if (!e) fields->present |= 1u << (FIELD);   \\"
+print "  }"
+print
+print "#define WRITE(FIELD, WRITER)                             \\"
+print "  if (count > (FIELD) && (amp_present(fields, FIELD) ?   \\"
+print "                          (WRITER) :                     \\"
+print "                          amp_write_null(pos, limit)))   \\"
+print "    return -1;"
+print
+print "#define SIZE(FIELD, SIZE) \\"
+print "  if (amp_present(fields, FIELD)) size += (SIZE);"
+print
+print "// up to the last field present, the rest are left off"
+print "static size_t amp_field_count(uint32_t present)"
+print "{"
+print "  size_t count = 0;"
+print "  while (count < 32 && present >> count) count++;"
+print "  return count;"
+print "}"
+print
+print "static bool amp_symbol_is(const char *sym, size_t size, const char *name)"
+print "{"
+print "  return size == strlen(name) && !memcmp(sym, name, size);"
+print "}"
+
+def reader(f, limit):
+  ctype, name, size = codec(f)
+  if ctype == "amp_bytes_t":
+    return "amp_read_%s(pos, %s, &fields->%s.size, &fields->%s.start)" % \
+        (name, limit, fname(f), fname(f))
+  else:
+    return "amp_read_%s(pos, %s, &fields->%s)" % (name, limit, fname(f))
+
+def writer(f):
+  ctype, name, size = codec(f)
+  if ctype == "amp_bytes_t":
+    return "amp_write_%s(pos, limit, fields->%s.size, fields->%s.start)" % \
+        (name, fname(f), fname(f))
+  else:
+    return "amp_write_%s(pos, limit, fields->%s)" % (name, fname(f))
+
+for type in TYPES:
+  t = fields_t(type)
+  name = tname(type)
+  kw = field_kw(type)
+  fields = list(type.query["field"])
+
+  print
+  print "static int amp_read_%s_list(char **pos, char *limit, %s *fields)" % (name, t)
+  print "{"
+  print "  size_t count;"
+  print "  char *end;"
+  if fields: print "  int e;"
+  print "  *fields = (%s) {0};" % t
+  print "  if (amp_read_list(pos, limit, &count, &end)) return -1;"
+  for f in fields:
+    print "  READ(%s_%s, %s);" % (kw, field_kw(f), reader(f, "end"))
+  print "  *pos = end;"
+  print "  return 0;"
+  print "}"
+
+  print
+  print "int amp_read_%s(char **pos, char *limit, %s *fields)" % (name, t)
+  print "{"
+  print "  char *start = *pos;"
+  print "  uint64_t code;"
+  print "  size_t size;"
+  print "  char *sym;"
+  print "  int e = amp_read_descriptor(pos, limit, &code, &size, &sym);"
+  print "  if (e < 0 || (e ? !amp_symbol_is(sym, size, %s_SYM) : code != %s_CODE)) {" % (kw, kw)
+  print "    *pos = start;"
+  print "    return -1;"
+  print "  }"
+  print "  if (amp_read_%s_list(pos, limit, fields)) {" % name
+  print "    *pos = start;"
+  print "    return -1;"
+  print "  }"
+  print "  return 0;"
+  print "}"
+
+  print
+  print "int amp_write_%s(char **pos, char *limit, const %s *fields)" % (name, t)
+  print "{"
+  print "  size_t count = amp_field_count(fields->present);"
+  print "  char *start;"
+  print "  if (amp_write_descriptor(pos, limit) ||"
+  print "      amp_write_ulong(pos, limit, %s_CODE) ||" % kw
+  print "      amp_write_start(pos, limit, &start))"
+  print "    return -1;"
+  for f in fields:
+    print "  WRITE(%s_%s, %s);" % (kw, field_kw(f), writer(f))
+  print "  return amp_write_list(pos, limit, start, count);"
+  print "}"
+
+  print
+  print "size_t amp_sizeof_%s(const %s *fields)" % (name, t)
+  print "{"
+  print "  // the descriptor and list head, then a byte for each field"
+  print "  size_t size = 19 + amp_field_count(fields->present);"
+  for f in fields:
+    print "  SIZE(%s_%s, %s);" % (kw, field_kw(f), codec(f)[2].replace("%s", "fields->%s" % fname(f)))
+  print "  return size;"
+  print "}"
+
+performatives = [t for t in TYPES if is_performative(t)]
+
+print
+print "int amp_read_performative(char **pos, char *limit, int *idx,"
+print "                          amp_performative_t *performative)"
+print "{"
+print "  char *start = *pos;"
+print "  uint64_t code;"
+print "  size_t size;"
+print "  char *bytes;"
+print "  int e = amp_read_descriptor(pos, limit, &code, &size, &bytes);"
+print "  if (e < 0) return e;"
+print "  *idx = e ? amp_performative_sym(bytes, size) : amp_performative_code(code);"
+print "  switch (*idx) {"
+for type in performatives:
+  print "  case %s_IDX:" % field_kw(type)
+  print "    e = amp_read_%s_list(pos, limit, &performative->%s);" % (tname(type), tname(type))
+  print "    break;"
+print "  default:"
+print "    e = amp_read_raw(pos, limit, &size, &bytes);"
+print "    break;"
+print "  }"
+print "  if (e < 0) *pos = start;"
+print "  return e < 0 ? e : 0;"
+print "}"
+
+print
+print "int amp_write_performative(char **pos, char *limit, int idx,"
+print "                           const amp_performative_t *performative)"
+print "{"
+print "  switch (idx) {"
+for type in performatives:
+  print "  case %s_IDX:" % field_kw(type)
+  print "    return amp_write_%s(pos, limit, &performative->%s);" % (tname(type), tname(type))
+print "  default:"
+print "    return -1;"
+print "  }"
+print "}"
+
+print
+print "size_t amp_sizeof_performative(int idx, const amp_performative_t *performative)"
+print "{"
+print "  switch (idx) {"
+for type in performatives:
+  print "  case %s_IDX:" % field_kw(type)
+  print "    return amp_sizeof_%s(&performative->%s);" % (tname(type), tname(type))
+print "  default:"
+print "    return 0;"
+print "  }"
+print "}"
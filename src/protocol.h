@@ -0,0 +1,553 @@
+/* generated */
+#ifndef _AMP_PROTOCOL_H
+#define _AMP_PROTOCOL_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OPEN_CONTAINER_ID (0)
+#define OPEN_HOSTNAME (1)
+#define OPEN_MAX_FRAME_SIZE (2)
+#define OPEN_CHANNEL_MAX (3)
+#define OPEN_IDLE_TIME_OUT (4)
+#define OPEN_OUTGOING_LOCALES (5)
+#define OPEN_INCOMING_LOCALES (6)
+#define OPEN_OFFERED_CAPABILITIES (7)
+#define OPEN_DESIRED_CAPABILITIES (8)
+#define OPEN_PROPERTIES (9)
+#define BEGIN_REMOTE_CHANNEL (0)
+#define BEGIN_NEXT_OUTGOING_ID (1)
+#define BEGIN_INCOMING_WINDOW (2)
+#define BEGIN_OUTGOING_WINDOW (3)
+#define BEGIN_HANDLE_MAX (4)
+#define BEGIN_OFFERED_CAPABILITIES (5)
+#define BEGIN_DESIRED_CAPABILITIES (6)
+#define BEGIN_PROPERTIES (7)
+#define ATTACH_NAME (0)
+#define ATTACH_HANDLE (1)
+#define ATTACH_ROLE (2)
+#define ATTACH_SND_SETTLE_MODE (3)
+#define ATTACH_RCV_SETTLE_MODE (4)
+#define ATTACH_SOURCE (5)
+#define ATTACH_TARGET (6)
+#define ATTACH_UNSETTLED (7)
+#define ATTACH_INCOMPLETE_UNSETTLED (8)
+#define ATTACH_INITIAL_DELIVERY_COUNT (9)
+#define ATTACH_MAX_MESSAGE_SIZE (10)
+#define ATTACH_OFFERED_CAPABILITIES (11)
+#define ATTACH_DESIRED_CAPABILITIES (12)
+#define ATTACH_PROPERTIES (13)
+#define FLOW_NEXT_INCOMING_ID (0)
+#define FLOW_INCOMING_WINDOW (1)
+#define FLOW_NEXT_OUTGOING_ID (2)
+#define FLOW_OUTGOING_WINDOW (3)
+#define FLOW_HANDLE (4)
+#define FLOW_DELIVERY_COUNT (5)
+#define FLOW_LINK_CREDIT (6)
+#define FLOW_AVAILABLE (7)
+#define FLOW_DRAIN (8)
+#define FLOW_ECHO (9)
+#define FLOW_PROPERTIES (10)
+#define TRANSFER_HANDLE (0)
+#define TRANSFER_DELIVERY_ID (1)
+#define TRANSFER_DELIVERY_TAG (2)
+#define TRANSFER_MESSAGE_FORMAT (3)
+#define TRANSFER_SETTLED (4)
+#define TRANSFER_MORE (5)
+#define TRANSFER_RCV_SETTLE_MODE (6)
+#define TRANSFER_STATE (7)
+#define TRANSFER_RESUME (8)
+#define TRANSFER_ABORTED (9)
+#define TRANSFER_BATCHABLE (10)
+#define DISPOSITION_ROLE (0)
+#define DISPOSITION_FIRST (1)
+#define DISPOSITION_LAST (2)
+#define DISPOSITION_SETTLED (3)
+#define DISPOSITION_STATE (4)
+#define DISPOSITION_BATCHABLE (5)
+#define DETACH_HANDLE (0)
+#define DETACH_CLOSED (1)
+#define DETACH_ERROR (2)
+#define END_ERROR (0)
+#define CLOSE_ERROR (0)
+#define ERROR_CONDITION (0)
+#define ERROR_DESCRIPTION (1)
+#define ERROR_INFO (2)
+#define HEADER_DURABLE (0)
+#define HEADER_PRIORITY (1)
+#define HEADER_TTL (2)
+#define HEADER_FIRST_ACQUIRER (3)
+#define HEADER_DELIVERY_COUNT (4)
+#define PROPERTIES_MESSAGE_ID (0)
+#define PROPERTIES_USER_ID (1)
+#define PROPERTIES_TO (2)
+#define PROPERTIES_SUBJECT (3)
+#define PROPERTIES_REPLY_TO (4)
+#define PROPERTIES_CORRELATION_ID (5)
+#define PROPERTIES_CONTENT_TYPE (6)
+#define PROPERTIES_CONTENT_ENCODING (7)
+#define PROPERTIES_ABSOLUTE_EXPIRY_TIME (8)
+#define PROPERTIES_CREATION_TIME (9)
+#define PROPERTIES_GROUP_ID (10)
+#define PROPERTIES_GROUP_SEQUENCE (11)
+#define PROPERTIES_REPLY_TO_GROUP_ID (12)
+#define RECEIVED_SECTION_NUMBER (0)
+#define RECEIVED_SECTION_OFFSET (1)
+#define REJECTED_ERROR (0)
+#define MODIFIED_DELIVERY_FAILED (0)
+#define MODIFIED_UNDELIVERABLE_HERE (1)
+#define MODIFIED_MESSAGE_ANNOTATIONS (2)
+#define SOURCE_ADDRESS (0)
+#define SOURCE_DURABLE (1)
+#define SOURCE_EXPIRY_POLICY (2)
+#define SOURCE_TIMEOUT (3)
+#define SOURCE_DYNAMIC (4)
+#define SOURCE_DYNAMIC_NODE_PROPERTIES (5)
+#define SOURCE_DISTRIBUTION_MODE (6)
+#define SOURCE_FILTER (7)
+#define SOURCE_DEFAULT_OUTCOME (8)
+#define SOURCE_OUTCOMES (9)
+#define SOURCE_CAPABILITIES (10)
+#define TARGET_ADDRESS (0)
+#define TARGET_DURABLE (1)
+#define TARGET_EXPIRY_POLICY (2)
+#define TARGET_TIMEOUT (3)
+#define TARGET_DYNAMIC (4)
+#define TARGET_DYNAMIC_NODE_PROPERTIES (5)
+#define TARGET_CAPABILITIES (6)
+#define OPEN_SYM ("amqp:open:list")
+#define OPEN_CODE (16)
+#define OPEN_IDX (0)
+#define BEGIN_SYM ("amqp:begin:list")
+#define BEGIN_CODE (17)
+#define BEGIN_IDX (1)
+#define ATTACH_SYM ("amqp:attach:list")
+#define ATTACH_CODE (18)
+#define ATTACH_IDX (2)
+#define FLOW_SYM ("amqp:flow:list")
+#define FLOW_CODE (19)
+#define FLOW_IDX (3)
+#define TRANSFER_SYM ("amqp:transfer:list")
+#define TRANSFER_CODE (20)
+#define TRANSFER_IDX (4)
+#define DISPOSITION_SYM ("amqp:disposition:list")
+#define DISPOSITION_CODE (21)
+#define DISPOSITION_IDX (5)
+#define DETACH_SYM ("amqp:detach:list")
+#define DETACH_CODE (22)
+#define DETACH_IDX (6)
+#define END_SYM ("amqp:end:list")
+#define END_CODE (23)
+#define END_IDX (7)
+#define CLOSE_SYM ("amqp:close:list")
+#define CLOSE_CODE (24)
+#define CLOSE_IDX (8)
+#define ERROR_SYM ("amqp:error:list")
+#define ERROR_CODE (29)
+#define ERROR_IDX (9)
+#define HEADER_SYM ("amqp:header:list")
+#define HEADER_CODE (112)
+#define HEADER_IDX (10)
+#define PROPERTIES_SYM ("amqp:properties:list")
+#define PROPERTIES_CODE (115)
+#define PROPERTIES_IDX (11)
+#define RECEIVED_SYM ("amqp:received:list")
+#define RECEIVED_CODE (35)
+#define RECEIVED_IDX (12)
+#define ACCEPTED_SYM ("amqp:accepted:list")
+#define ACCEPTED_CODE (36)
+#define ACCEPTED_IDX (13)
+#define REJECTED_SYM ("amqp:rejected:list")
+#define REJECTED_CODE (37)
+#define REJECTED_IDX (14)
+#define RELEASED_SYM ("amqp:released:list")
+#define RELEASED_CODE (38)
+#define RELEASED_IDX (15)
+#define MODIFIED_SYM ("amqp:modified:list")
+#define MODIFIED_CODE (39)
+#define MODIFIED_IDX (16)
+#define SOURCE_SYM ("amqp:source:list")
+#define SOURCE_CODE (40)
+#define SOURCE_IDX (17)
+#define TARGET_SYM ("amqp:target:list")
+#define TARGET_CODE (41)
+#define TARGET_IDX (18)
+#define DELETE_ON_CLOSE_SYM ("amqp:delete-on-close:list")
+#define DELETE_ON_CLOSE_CODE (43)
+#define DELETE_ON_CLOSE_IDX (19)
+#define DELETE_ON_NO_LINKS_SYM ("amqp:delete-on-no-links:list")
+#define DELETE_ON_NO_LINKS_CODE (44)
+#define DELETE_ON_NO_LINKS_IDX (20)
+#define DELETE_ON_NO_MESSAGES_SYM ("amqp:delete-on-no-messages:list")
+#define DELETE_ON_NO_MESSAGES_CODE (45)
+#define DELETE_ON_NO_MESSAGES_IDX (21)
+#define DELETE_ON_NO_LINKS_OR_MESSAGES_SYM ("amqp:delete-on-no-links-or-messages:list")
+#define DELETE_ON_NO_LINKS_OR_MESSAGES_CODE (46)
+#define DELETE_ON_NO_LINKS_OR_MESSAGES_IDX (22)
+
+#define PERFORMATIVES (9)
+
+/* *_IDX of the performative with the given descriptor code, -1 if
+   it is not one */
+static inline int amp_performative_code(uint64_t code)
+{
+  static const signed char idx[] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+  return code >= 16 && code <= 24 ? idx[code - 16] : -1;
+}
+
+/* the same for a symbolic descriptor */
+static inline int amp_performative_sym(const char *sym, size_t size)
+{
+  switch (size) {
+  case 13:
+    switch (sym[0]) {
+    case 'a': return memcmp(sym, END_SYM, 13) ? -1 : END_IDX;
+    }
+    break;
+  case 14:
+    switch (sym[5]) {
+    case 'o': return memcmp(sym, OPEN_SYM, 14) ? -1 : OPEN_IDX;
+    case 'f': return memcmp(sym, FLOW_SYM, 14) ? -1 : FLOW_IDX;
+    }
+    break;
+  case 15:
+    switch (sym[5]) {
+    case 'b': return memcmp(sym, BEGIN_SYM, 15) ? -1 : BEGIN_IDX;
+    case 'c': return memcmp(sym, CLOSE_SYM, 15) ? -1 : CLOSE_IDX;
+    }
+    break;
+  case 16:
+    switch (sym[5]) {
+    case 'a': return memcmp(sym, ATTACH_SYM, 16) ? -1 : ATTACH_IDX;
+    case 'd': return memcmp(sym, DETACH_SYM, 16) ? -1 : DETACH_IDX;
+    }
+    break;
+  case 18:
+    switch (sym[0]) {
+    case 'a': return memcmp(sym, TRANSFER_SYM, 18) ? -1 : TRANSFER_IDX;
+    }
+    break;
+  case 21:
+    switch (sym[0]) {
+    case 'a': return memcmp(sym, DISPOSITION_SYM, 21) ? -1 : DISPOSITION_IDX;
+    }
+    break;
+  }
+  return -1;
+}
+
+static inline const char *amp_performative_name(int idx)
+{
+  static const char *names[] = {"OPEN", "BEGIN", "ATTACH", "FLOW", "TRANSFER", "DISPOSITION", "DETACH", "END", "CLOSE"};
+  return idx >= 0 && idx < PERFORMATIVES ? names[idx] : "<UNKNOWN>";
+}
+
+/* the fields of each composite type, present has the bit for each
+   field that is there, bytes and values of other types point into
+   the encoded performative they were read from */
+typedef struct {
+  size_t size;
+  char *start;
+} amp_bytes_t;
+
+#define amp_present(FIELDS, FIELD) (((FIELDS)->present >> (FIELD)) & 1)
+#define amp_set_field(FIELDS, FIELD, MEMBER, VALUE) \
+  ((FIELDS)->MEMBER = (VALUE), (FIELDS)->present |= 1u << (FIELD))
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t container_id;
+  amp_bytes_t hostname;
+  uint32_t max_frame_size;
+  uint16_t channel_max;
+  uint32_t idle_time_out;
+  amp_bytes_t outgoing_locales;
+  amp_bytes_t incoming_locales;
+  amp_bytes_t offered_capabilities;
+  amp_bytes_t desired_capabilities;
+  amp_bytes_t properties;
+} amp_open_fields_t;
+
+typedef struct {
+  uint32_t present;
+  uint16_t remote_channel;
+  uint32_t next_outgoing_id;
+  uint32_t incoming_window;
+  uint32_t outgoing_window;
+  uint32_t handle_max;
+  amp_bytes_t offered_capabilities;
+  amp_bytes_t desired_capabilities;
+  amp_bytes_t properties;
+} amp_begin_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t name;
+  uint32_t handle;
+  bool role;
+  uint8_t snd_settle_mode;
+  uint8_t rcv_settle_mode;
+  amp_bytes_t source;
+  amp_bytes_t target;
+  amp_bytes_t unsettled;
+  bool incomplete_unsettled;
+  uint32_t initial_delivery_count;
+  uint64_t max_message_size;
+  amp_bytes_t offered_capabilities;
+  amp_bytes_t desired_capabilities;
+  amp_bytes_t properties;
+} amp_attach_fields_t;
+
+typedef struct {
+  uint32_t present;
+  uint32_t next_incoming_id;
+  uint32_t incoming_window;
+  uint32_t next_outgoing_id;
+  uint32_t outgoing_window;
+  uint32_t handle;
+  uint32_t delivery_count;
+  uint32_t link_credit;
+  uint32_t available;
+  bool drain;
+  bool echo;
+  amp_bytes_t properties;
+} amp_flow_fields_t;
+
+typedef struct {
+  uint32_t present;
+  uint32_t handle;
+  uint32_t delivery_id;
+  amp_bytes_t delivery_tag;
+  uint32_t message_format;
+  bool settled;
+  bool more;
+  uint8_t rcv_settle_mode;
+  amp_bytes_t state;
+  bool resume;
+  bool aborted;
+  bool batchable;
+} amp_transfer_fields_t;
+
+typedef struct {
+  uint32_t present;
+  bool role;
+  uint32_t first;
+  uint32_t last;
+  bool settled;
+  amp_bytes_t state;
+  bool batchable;
+} amp_disposition_fields_t;
+
+typedef struct {
+  uint32_t present;
+  uint32_t handle;
+  bool closed;
+  amp_bytes_t error;
+} amp_detach_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t error;
+} amp_end_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t error;
+} amp_close_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t condition;
+  amp_bytes_t description;
+  amp_bytes_t info;
+} amp_error_fields_t;
+
+typedef struct {
+  uint32_t present;
+  bool durable;
+  uint8_t priority;
+  uint32_t ttl;
+  bool first_acquirer;
+  uint32_t delivery_count;
+} amp_header_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t message_id;
+  amp_bytes_t user_id;
+  amp_bytes_t to;
+  amp_bytes_t subject;
+  amp_bytes_t reply_to;
+  amp_bytes_t correlation_id;
+  amp_bytes_t content_type;
+  amp_bytes_t content_encoding;
+  amp_bytes_t absolute_expiry_time;
+  amp_bytes_t creation_time;
+  amp_bytes_t group_id;
+  uint32_t group_sequence;
+  amp_bytes_t reply_to_group_id;
+} amp_properties_fields_t;
+
+typedef struct {
+  uint32_t present;
+  uint32_t section_number;
+  uint64_t section_offset;
+} amp_received_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_accepted_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t error;
+} amp_rejected_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_released_fields_t;
+
+typedef struct {
+  uint32_t present;
+  bool delivery_failed;
+  bool undeliverable_here;
+  amp_bytes_t message_annotations;
+} amp_modified_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t address;
+  uint32_t durable;
+  amp_bytes_t expiry_policy;
+  uint32_t timeout;
+  bool dynamic;
+  amp_bytes_t dynamic_node_properties;
+  amp_bytes_t distribution_mode;
+  amp_bytes_t filter;
+  amp_bytes_t default_outcome;
+  amp_bytes_t outcomes;
+  amp_bytes_t capabilities;
+} amp_source_fields_t;
+
+typedef struct {
+  uint32_t present;
+  amp_bytes_t address;
+  uint32_t durable;
+  amp_bytes_t expiry_policy;
+  uint32_t timeout;
+  bool dynamic;
+  amp_bytes_t dynamic_node_properties;
+  amp_bytes_t capabilities;
+} amp_target_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_delete_on_close_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_delete_on_no_links_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_delete_on_no_messages_fields_t;
+
+typedef struct {
+  uint32_t present;
+} amp_delete_on_no_links_or_messages_fields_t;
+
+typedef union amp_performative {
+  amp_open_fields_t open;
+  amp_begin_fields_t begin;
+  amp_attach_fields_t attach;
+  amp_flow_fields_t flow;
+  amp_transfer_fields_t transfer;
+  amp_disposition_fields_t disposition;
+  amp_detach_fields_t detach;
+  amp_end_fields_t end;
+  amp_close_fields_t close;
+} amp_performative_t;
+
+/* the readers and writers go by the codec's conventions, a type is
+   written with its descriptor and sizeof is at most what that takes */
+int amp_read_open(char **pos, char *limit, amp_open_fields_t *fields);
+int amp_write_open(char **pos, char *limit, const amp_open_fields_t *fields);
+size_t amp_sizeof_open(const amp_open_fields_t *fields);
+int amp_read_begin(char **pos, char *limit, amp_begin_fields_t *fields);
+int amp_write_begin(char **pos, char *limit, const amp_begin_fields_t *fields);
+size_t amp_sizeof_begin(const amp_begin_fields_t *fields);
+int amp_read_attach(char **pos, char *limit, amp_attach_fields_t *fields);
+int amp_write_attach(char **pos, char *limit, const amp_attach_fields_t *fields);
+size_t amp_sizeof_attach(const amp_attach_fields_t *fields);
+int amp_read_flow(char **pos, char *limit, amp_flow_fields_t *fields);
+int amp_write_flow(char **pos, char *limit, const amp_flow_fields_t *fields);
+size_t amp_sizeof_flow(const amp_flow_fields_t *fields);
+int amp_read_transfer(char **pos, char *limit, amp_transfer_fields_t *fields);
+int amp_write_transfer(char **pos, char *limit, const amp_transfer_fields_t *fields);
+size_t amp_sizeof_transfer(const amp_transfer_fields_t *fields);
+int amp_read_disposition(char **pos, char *limit, amp_disposition_fields_t *fields);
+int amp_write_disposition(char **pos, char *limit, const amp_disposition_fields_t *fields);
+size_t amp_sizeof_disposition(const amp_disposition_fields_t *fields);
+int amp_read_detach(char **pos, char *limit, amp_detach_fields_t *fields);
+int amp_write_detach(char **pos, char *limit, const amp_detach_fields_t *fields);
+size_t amp_sizeof_detach(const amp_detach_fields_t *fields);
+int amp_read_end(char **pos, char *limit, amp_end_fields_t *fields);
+int amp_write_end(char **pos, char *limit, const amp_end_fields_t *fields);
+size_t amp_sizeof_end(const amp_end_fields_t *fields);
+int amp_read_close(char **pos, char *limit, amp_close_fields_t *fields);
+int amp_write_close(char **pos, char *limit, const amp_close_fields_t *fields);
+size_t amp_sizeof_close(const amp_close_fields_t *fields);
+int amp_read_error(char **pos, char *limit, amp_error_fields_t *fields);
+int amp_write_error(char **pos, char *limit, const amp_error_fields_t *fields);
+size_t amp_sizeof_error(const amp_error_fields_t *fields);
+int amp_read_header(char **pos, char *limit, amp_header_fields_t *fields);
+int amp_write_header(char **pos, char *limit, const amp_header_fields_t *fields);
+size_t amp_sizeof_header(const amp_header_fields_t *fields);
+int amp_read_properties(char **pos, char *limit, amp_properties_fields_t *fields);
+int amp_write_properties(char **pos, char *limit, const amp_properties_fields_t *fields);
+size_t amp_sizeof_properties(const amp_properties_fields_t *fields);
+int amp_read_received(char **pos, char *limit, amp_received_fields_t *fields);
+int amp_write_received(char **pos, char *limit, const amp_received_fields_t *fields);
+size_t amp_sizeof_received(const amp_received_fields_t *fields);
+int amp_read_accepted(char **pos, char *limit, amp_accepted_fields_t *fields);
+int amp_write_accepted(char **pos, char *limit, const amp_accepted_fields_t *fields);
+size_t amp_sizeof_accepted(const amp_accepted_fields_t *fields);
+int amp_read_rejected(char **pos, char *limit, amp_rejected_fields_t *fields);
+int amp_write_rejected(char **pos, char *limit, const amp_rejected_fields_t *fields);
+size_t amp_sizeof_rejected(const amp_rejected_fields_t *fields);
+int amp_read_released(char **pos, char *limit, amp_released_fields_t *fields);
+int amp_write_released(char **pos, char *limit, const amp_released_fields_t *fields);
+size_t amp_sizeof_released(const amp_released_fields_t *fields);
+int amp_read_modified(char **pos, char *limit, amp_modified_fields_t *fields);
+int amp_write_modified(char **pos, char *limit, const amp_modified_fields_t *fields);
+size_t amp_sizeof_modified(const amp_modified_fields_t *fields);
+int amp_read_source(char **pos, char *limit, amp_source_fields_t *fields);
+int amp_write_source(char **pos, char *limit, const amp_source_fields_t *fields);
+size_t amp_sizeof_source(const amp_source_fields_t *fields);
+int amp_read_target(char **pos, char *limit, amp_target_fields_t *fields);
+int amp_write_target(char **pos, char *limit, const amp_target_fields_t *fields);
+size_t amp_sizeof_target(const amp_target_fields_t *fields);
+int amp_read_delete_on_close(char **pos, char *limit, amp_delete_on_close_fields_t *fields);
+int amp_write_delete_on_close(char **pos, char *limit, const amp_delete_on_close_fields_t *fields);
+size_t amp_sizeof_delete_on_close(const amp_delete_on_close_fields_t *fields);
+int amp_read_delete_on_no_links(char **pos, char *limit, amp_delete_on_no_links_fields_t *fields);
+int amp_write_delete_on_no_links(char **pos, char *limit, const amp_delete_on_no_links_fields_t *fields);
+size_t amp_sizeof_delete_on_no_links(const amp_delete_on_no_links_fields_t *fields);
+int amp_read_delete_on_no_messages(char **pos, char *limit, amp_delete_on_no_messages_fields_t *fields);
+int amp_write_delete_on_no_messages(char **pos, char *limit, const amp_delete_on_no_messages_fields_t *fields);
+size_t amp_sizeof_delete_on_no_messages(const amp_delete_on_no_messages_fields_t *fields);
+int amp_read_delete_on_no_links_or_messages(char **pos, char *limit, amp_delete_on_no_links_or_messages_fields_t *fields);
+int amp_write_delete_on_no_links_or_messages(char **pos, char *limit, const amp_delete_on_no_links_or_messages_fields_t *fields);
+size_t amp_sizeof_delete_on_no_links_or_messages(const amp_delete_on_no_links_or_messages_fields_t *fields);
+
+/* idx is the *_IDX of the performative, by code or by symbol, or -1
+   for one that is not known, which the reader skips */
+int amp_read_performative(char **pos, char *limit, int *idx,
+                          amp_performative_t *performative);
+int amp_write_performative(char **pos, char *limit, int idx,
+                           const amp_performative_t *performative);
+size_t amp_sizeof_performative(int idx, const amp_performative_t *performative);
+
+#endif /* protocol.h */
@@ -24,6 +24,11 @@ print "/* generated */"
 print "#ifndef _AMP_PROTOCOL_H"
 print "#define _AMP_PROTOCOL_H 1"
 print
+print "#include <stdbool.h>"
+print "#include <stddef.h>"
+print "#include <stdint.h>"
+print "#include <string.h>"
+print
 
 for type in TYPES:
   fidx = 0
@@ -32,6 +37,7 @@ for type in TYPES:
     fidx += 1
 
 idx = 0
+performatives = []
 
 for type in TYPES:
   desc = type["descriptor"]
@@ -41,7 +47,116 @@ for type in TYPES:
   code = (hi << 32) + lo
   print "#define %s_CODE (%s)" % (name, code)
   print "#define %s_IDX (%s)" % (name, idx)
+  if type["@provides"] == "frame":
+    performatives.append((idx, name, code, desc["@name"]))
   idx += 1
 
+# the performatives come first, so their *_IDX can index a table of
+# handlers directly
+assert [p[0] for p in performatives] == range(len(performatives))
+
+codes = [p[2] for p in performatives]
+lo, hi = min(codes), max(codes)
+table = [-1]*(hi - lo + 1)
+for idx, name, code, sym in performatives:
+  table[code - lo] = idx
+
+print
+print "#define PERFORMATIVES (%s)" % len(performatives)
+print
+print "/* *_IDX of the performative with the given descriptor code, -1 if"
+print "   it is not one */"
+print "static inline int amp_performative_code(uint64_t code)"
+print "{"
+print "  static const signed char idx[] = {%s};" % ", ".join(map(str, table))
+print "  return code >= %s && code <= %s ? idx[code - %s] : -1;" % (lo, hi, lo)
+print "}"
+
+# symbols are told apart by their size and then by a character at
+# which all symbols of that size differ, leaving one memcmp to confirm
+sizes = {}
+for p in performatives:
+  sizes.setdefault(len(p[3]), []).append(p)
+
+def split(syms):
+  for i in range(min(map(len, syms))):
+    if len(set(s[i] for s in syms)) == len(syms):
+      return i
+  raise Exception("no distinguishing character: %s" % syms)
+
+print
+print "/* the same for a symbolic descriptor */"
+print "static inline int amp_performative_sym(const char *sym, size_t size)"
+print "{"
+print "  switch (size) {"
+for size in sorted(sizes):
+  group = sizes[size]
+  pos = split([p[3] for p in group])
+  print "  case %s:" % size
+  print "    switch (sym[%s]) {" % pos
+  for idx, name, code, s in group:
+    print "    case '%s': return memcmp(sym, %s_SYM, %s) ? -1 : %s_IDX;" % (s[pos], name, size, name)
+  print "    }"
+  print "    break;"
+print "  }"
+print "  return -1;"
+print "}"
+
+print
+print "static inline const char *amp_performative_name(int idx)"
+print "{"
+print "  static const char *names[] = {%s};" % \
+    ", ".join(['"%s"' % p[1] for p in performatives])
+print "  return idx >= 0 && idx < PERFORMATIVES ? names[idx] : \"<UNKNOWN>\";"
+print "}"
+
+print
+print "/* the fields of each composite type, present has the bit for each"
+print "   field that is there, bytes and values of other types point into"
+print "   the encoded performative they were read from */"
+print "typedef struct {"
+print "  size_t size;"
+print "  char *start;"
+print "} amp_bytes_t;"
+print
+print "#define amp_present(FIELDS, FIELD) (((FIELDS)->present >> (FIELD)) & 1)"
+print "#define amp_set_field(FIELDS, FIELD, MEMBER, VALUE) \\"
+print "  ((FIELDS)->MEMBER = (VALUE), (FIELDS)->present |= 1u << (FIELD))"
+
+for type in TYPES:
+  fields = list(type.query["field"])
+  assert len(fields) <= 32
+  print
+  print "typedef struct {"
+  print "  uint32_t present;"
+  for f in fields:
+    print "  %s %s;" % (codec(f)[0], fname(f))
+  print "} %s;" % fields_t(type)
+
+print
+print "typedef union amp_performative {"
+for type in TYPES:
+  if is_performative(type):
+    print "  %s %s;" % (fields_t(type), tname(type))
+print "} amp_performative_t;"
+
+print
+print "/* the readers and writers go by the codec's conventions, a type is"
+print "   written with its descriptor and sizeof is at most what that takes */"
+for type in TYPES:
+  t = fields_t(type)
+  print "int amp_read_%s(char **pos, char *limit, %s *fields);" % (tname(type), t)
+  print "int amp_write_%s(char **pos, char *limit, const %s *fields);" % (tname(type), t)
+  print "size_t amp_sizeof_%s(const %s *fields);" % (tname(type), t)
+
+print
+print "/* idx is the *_IDX of the performative, by code or by symbol, or -1"
+print "   for one that is not known, which the reader skips */"
+print "int amp_read_performative(char **pos, char *limit, int *idx,"
+print "                          amp_performative_t *performative);"
+print "int amp_write_performative(char **pos, char *limit, int idx,"
+print "                           const amp_performative_t *performative);"
+print "size_t amp_sizeof_performative(int idx, const amp_performative_t *performative);"
+
 print
 print "#endif /* protocol.h */"
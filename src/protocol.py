@@ -108,3 +108,29 @@ def declaration(field):
 
 def field_kw(field):
   return fname(field).upper()
+
+# how fields of each type are held in the generated structs: the C
+# type, the codec functions that read and write it and at most how many
+# bytes its encoding takes beyond the first, fields of any other type
+# are held as they are encoded
+CODECS = {
+  "boolean": ("bool", "boolean", "1"),
+  "ubyte": ("uint8_t", "ubyte", "1"),
+  "ushort": ("uint16_t", "ushort", "2"),
+  "uint": ("uint32_t", "uint", "4"),
+  "ulong": ("uint64_t", "ulong", "8"),
+  "binary": ("amp_bytes_t", "binary", "4 + %s.size"),
+  "string": ("amp_bytes_t", "utf8", "4 + %s.size"),
+  "symbol": ("amp_bytes_t", "symbol", "4 + %s.size")
+  }
+
+RAW = ("amp_bytes_t", "raw", "%s.size - 1")
+
+def codec(field):
+  return CODECS.get(ftype(field), RAW)
+
+def fields_t(t):
+  return "amp_%s_fields_t" % tname(t)
+
+def is_performative(t):
+  return t["@provides"] == "frame"
@@ -1,10 +1,31 @@
+#include <amp/codec.h>
 #include <amp/engine.h>
+#include <amp/framing.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "engine/engine-internal.h"
+#include "protocol.h"
 
-int main(int argc, char **argv)
+#define CHECK(COND)                                                     \
+  do {                                                                  \
+    if (!(COND)) {                                                      \
+      fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #COND); \
+      exit(1);                                                          \
+    }                                                                   \
+  } while (0)
+
+static amp_delivery_t *tagged(amp_link_t *link, char *tag)
+{
+  amp_binary_t *bin = amp_binary(tag, strlen(tag));
+  amp_delivery_t *d = amp_delivery(link, bin);
+  amp_free_binary(bin);
+  return d;
+}
+
+static void test_links(void)
 {
   amp_connection_t *conn = amp_connection();
   amp_open((amp_endpoint_t *)conn);
@@ -24,13 +45,13 @@ int main(int argc, char **argv)
         l = (amp_link_t *) amp_receiver(ssn, L"receiver");
       for (int k = 0; k < 4; k++)
       {
-        amp_delivery(l, strtag("tag0"));
+        tagged(l, "tag0");
       }
       amp_open((amp_endpoint_t *)l);
       amp_link_dump(l);
-      amp_delivery_t *d = amp_delivery(l, strtag("tag1"));
+      amp_delivery_t *d = tagged(l, "tag1");
       for (int k = 0; k < 16; k++) {
-        d = amp_delivery(l, strtag("tag2"));
+        d = tagged(l, "tag2");
         amp_settle(d);
       }
       amp_link_dump(l);
@@ -40,5 +61,338 @@ int main(int argc, char **argv)
   amp_dump(conn);
 
   amp_destroy((amp_endpoint_t *)conn);
+}
+
+// every session opened puts a BEGIN on the next channel behind the
+// OPEN, so the order the frames come out in shows whether the ring
+// kept it
+static size_t test_check_frames(char *bytes, size_t size)
+{
+  size_t frames = 0;
+  int channel = -1;
+  while (size) {
+    amp_frame_t frame;
+    size_t n = amp_read_frame(&frame, bytes, size);
+    CHECK(n);
+    amp_performative_t performative;
+    int idx;
+    char *pos = frame.payload;
+    CHECK(!amp_read_performative(&pos, frame.payload + frame.size, &idx, &performative));
+    if (frames) {
+      CHECK(idx == BEGIN_IDX);
+      CHECK(channel < 0 || frame.channel == channel + 1);
+      channel = frame.channel;
+    } else {
+      CHECK(idx == OPEN_IDX);
+    }
+    frames++;
+    bytes += n;
+    size -= n;
+  }
+  return frames;
+}
+
+// takes up to n bytes off the front of the output, the way a short
+// write would, and appends them to out
+static size_t test_take(amp_transport_t *transport, size_t n, char *out)
+{
+  struct iovec iov[2];
+  int count = amp_output_iov(transport, iov, 2);
+  CHECK(count >= 0);
+  size_t taken = 0;
+  for (int i = 0; i < count && taken < n; i++) {
+    size_t len = iov[i].iov_len < n - taken ? iov[i].iov_len : n - taken;
+    memcpy(out + taken, iov[i].iov_base, len);
+    taken += len;
+  }
+  amp_output_consume(transport, taken);
+  return taken;
+}
+
+static void test_output_ring(void)
+{
+  amp_connection_t *conn = amp_connection();
+  amp_transport_t *transport = amp_transport(conn);
+  amp_open((amp_endpoint_t *) conn);
+
+  size_t capacity = 1024*1024;
+  char *out = malloc(capacity);
+  size_t size = 0;
+  int sessions = 0;
+  bool wrapped = false, split = false;
+
+  // steady output drained by short writes laps the ring and wraps it
+  for (int round = 0; round < 400; round++) {
+    for (int i = 0; i < 3; i++, sessions++)
+      amp_open((amp_endpoint_t *) amp_session(conn));
+    struct iovec iov[2];
+    int count = amp_output_iov(transport, iov, 2);
+    wrapped |= transport->wrap != 0;
+    split |= count == 2;
+    CHECK(transport->capacity == 4*1024);
+    size += test_take(transport, transport->available - 61, out + size);
+  }
+  CHECK(wrapped && split);
+
+  // output that piles up past the ring makes it grow, iovecs handed out
+  // before then still point at the pending bytes in the old buffer
+  struct iovec before[2];
+  int count = amp_output_iov(transport, before, 2);
+  CHECK(count > 0);
+  size_t pending = 0;
+  for (int i = 0; i < count; i++) pending += before[i].iov_len;
+  char *copy = malloc(pending);
+  for (int i = 0, at = 0; i < count; at += before[i].iov_len, i++)
+    memcpy(copy + at, before[i].iov_base, before[i].iov_len);
+  for (int i = 0; i < 200; i++, sessions++)
+    amp_open((amp_endpoint_t *) amp_session(conn));
+  struct iovec after[2];
+  amp_output_iov(transport, after, 2);
+  CHECK(transport->capacity > 4*1024);
+  CHECK(transport->retired_head);
+  for (int i = 0, at = 0; i < count; at += before[i].iov_len, i++)
+    CHECK(!memcmp(copy + at, before[i].iov_base, before[i].iov_len));
+  free(copy);
+
+  // each old buffer goes once the last byte that was pending in it when
+  // the ring outgrew it is consumed, and not before
+  CHECK(transport->retired_head->until - transport->consumed >= pending);
+  while (transport->retired_head) {
+    amp_retired_t *retired = transport->retired_head;
+    size += test_take(transport, retired->until - transport->consumed - 1, out + size);
+    CHECK(transport->retired_head == retired);
+    size += test_take(transport, 1, out + size);
+    CHECK(transport->retired_head != retired);
+  }
+  while (transport->available)
+    size += test_take(transport, 97, out + size);
+  CHECK(size < capacity);
+  CHECK(test_check_frames(out, size) == 1 + sessions);
+
+  free(out);
+  amp_destroy((amp_endpoint_t *) conn);
+}
+
+static int read_ubyte(char **pos, char *limit)
+{
+  uint8_t v;
+  return amp_read_ubyte(pos, limit, &v);
+}
+
+static int read_uint(char **pos, char *limit)
+{
+  uint32_t v;
+  return amp_read_uint(pos, limit, &v);
+}
+
+static int read_ulong(char **pos, char *limit)
+{
+  uint64_t v;
+  return amp_read_ulong(pos, limit, &v);
+}
+
+static int read_symbol(char **pos, char *limit)
+{
+  size_t size;
+  char *v;
+  return amp_read_symbol(pos, limit, &size, &v);
+}
+
+static int read_binary(char **pos, char *limit)
+{
+  size_t size;
+  char *v;
+  return amp_read_binary(pos, limit, &size, &v);
+}
+
+static int read_list(char **pos, char *limit)
+{
+  size_t count;
+  char *end;
+  int e = amp_read_list(pos, limit, &count, &end);
+  if (!e) *pos = end;
+  return e;
+}
+
+static int read_descriptor(char **pos, char *limit)
+{
+  uint64_t code;
+  size_t size;
+  char *sym;
+  return amp_read_descriptor(pos, limit, &code, &size, &sym);
+}
+
+static int read_performative(char **pos, char *limit)
+{
+  amp_performative_t performative;
+  int idx;
+  return amp_read_performative(pos, limit, &idx, &performative);
+}
+
+static int read_transfer(char **pos, char *limit)
+{
+  amp_transfer_fields_t transfer;
+  return amp_read_transfer(pos, limit, &transfer);
+}
+
+// the whole encoding reads, every shorter prefix of it fails without
+// moving pos
+static void check_truncated(char *bytes, size_t size, int (*read)(char **, char *))
+{
+  char *pos = bytes;
+  CHECK(read(&pos, bytes + size) >= 0);
+  CHECK(pos == bytes + size);
+  for (size_t cut = 0; cut < size; cut++) {
+    pos = bytes;
+    CHECK(read(&pos, bytes + cut) < 0);
+    CHECK(pos == bytes);
+  }
+}
+
+static void test_decode_truncated(void)
+{
+  char buf[1024], big[300];
+  char *pos, *start;
+  memset(big, 'x', sizeof(big));
+
+  pos = buf;
+  CHECK(!amp_write_ubyte(&pos, buf + sizeof(buf), 7));
+  check_truncated(buf, pos - buf, read_ubyte);
+  pos = buf;
+  CHECK(!amp_write_uint(&pos, buf + sizeof(buf), 70000));
+  check_truncated(buf, pos - buf, read_uint);
+  pos = buf;
+  CHECK(!amp_write_ulong(&pos, buf + sizeof(buf), 0x123456789ull));
+  check_truncated(buf, pos - buf, read_ulong);
+  pos = buf;
+  CHECK(!amp_write_symbol(&pos, buf + sizeof(buf), 6, "amqp:x"));
+  check_truncated(buf, pos - buf, read_symbol);
+  pos = buf;
+  CHECK(!amp_write_binary(&pos, buf + sizeof(buf), sizeof(big), big));
+  check_truncated(buf, pos - buf, read_binary);
+  pos = buf;
+  CHECK(!amp_write_start(&pos, buf + sizeof(buf), &start));
+  CHECK(!amp_write_uint(&pos, buf + sizeof(buf), 1));
+  CHECK(!amp_write_symbol(&pos, buf + sizeof(buf), 6, "amqp:x"));
+  CHECK(!amp_write_list(&pos, buf + sizeof(buf), start, 2));
+  check_truncated(buf, pos - buf, read_list);
+  pos = buf;
+  CHECK(!amp_write_descriptor(&pos, buf + sizeof(buf)));
+  CHECK(!amp_write_ulong(&pos, buf + sizeof(buf), TRANSFER_CODE));
+  check_truncated(buf, pos - buf, read_descriptor);
+
+  amp_performative_t performative = {{0}};
+  amp_transfer_fields_t *transfer = &performative.transfer;
+  amp_set_field(transfer, TRANSFER_HANDLE, handle, 3);
+  amp_set_field(transfer, TRANSFER_DELIVERY_ID, delivery_id, 70000);
+  amp_set_field(transfer, TRANSFER_DELIVERY_TAG, delivery_tag, ((amp_bytes_t) {4, "tag0"}));
+  amp_set_field(transfer, TRANSFER_SETTLED, settled, true);
+  pos = buf;
+  CHECK(!amp_write_performative(&pos, buf + sizeof(buf), TRANSFER_IDX, &performative));
+  CHECK(pos - buf == amp_sizeof_performative(TRANSFER_IDX, &performative));
+  check_truncated(buf, pos - buf, read_performative);
+  check_truncated(buf, pos - buf, read_transfer);
+
+  char *end = pos;
+  int idx;
+  amp_performative_t read;
+  pos = buf;
+  CHECK(!amp_read_performative(&pos, end, &idx, &read));
+  CHECK(idx == TRANSFER_IDX);
+  CHECK(read.transfer.present == transfer->present);
+  CHECK(read.transfer.handle == 3 && read.transfer.delivery_id == 70000);
+  CHECK(read.transfer.delivery_tag.size == 4 &&
+        !memcmp(read.transfer.delivery_tag.start, "tag0", 4));
+  CHECK(read.transfer.settled);
+}
+
+static void test_decode_malformed(void)
+{
+  char buf[64];
+  char *pos;
+  uint8_t ubyte;
+  uint32_t uint;
+
+  // a value that doesn't fit, or isn't of the type asked for
+  pos = buf;
+  CHECK(!amp_write_uint(&pos, buf + sizeof(buf), 300));
+  pos = buf;
+  CHECK(amp_read_ubyte(&pos, buf + sizeof(buf), &ubyte) < 0 && pos == buf);
+  pos = buf;
+  CHECK(!amp_write_symbol(&pos, buf + sizeof(buf), 4, "open"));
+  pos = buf;
+  CHECK(amp_read_uint(&pos, buf + sizeof(buf), &uint) < 0 && pos == buf);
+
+  // a list claiming to run past the end of the bytes
+  char overrun[] = {(char) 0xc0, 40, 1, 0x40};
+  pos = overrun;
+  CHECK(read_list(&pos, overrun + sizeof(overrun)) < 0 && pos == overrun);
+
+  // the typed readers take their own descriptor only
+  amp_performative_t performative = {{0}};
+  pos = buf;
+  CHECK(!amp_write_performative(&pos, buf + sizeof(buf), END_IDX, &performative));
+  char *end = pos;
+  amp_transfer_fields_t transfer;
+  pos = buf;
+  CHECK(amp_read_transfer(&pos, end, &transfer) < 0 && pos == buf);
+
+  // a symbolic descriptor is looked up by name, an unknown one reads as
+  // idx -1
+  char sym[64];
+  char *list = buf;
+  uint64_t code;
+  size_t size;
+  char *name;
+  int idx;
+  CHECK(!amp_read_descriptor(&list, end, &code, &size, &name));
+  pos = sym;
+  CHECK(!amp_write_descriptor(&pos, sym + sizeof(sym)));
+  CHECK(!amp_write_symbol(&pos, sym + sizeof(sym), strlen(END_SYM), END_SYM));
+  name = pos - strlen(END_SYM);
+  CHECK(!amp_write_raw(&pos, sym + sizeof(sym), end - list, list));
+  end = pos;
+  pos = sym;
+  CHECK(!amp_read_performative(&pos, end, &idx, &performative));
+  CHECK(idx == END_IDX && pos == end);
+  memcpy(name, "amqp:bad", 8);
+  pos = sym;
+  CHECK(!amp_read_performative(&pos, end, &idx, &performative));
+  CHECK(idx == -1 && pos == end);
+}
+
+// a frame that decodes but holds no performative we know fails the
+// connection instead of being passed over
+static void test_decode_unknown(void)
+{
+  amp_connection_t *conn = amp_connection();
+  amp_transport_t *transport = amp_transport(conn);
+
+  char frame[64];
+  char *pos = frame + AMQP_HEADER_SIZE;
+  char *limit = frame + sizeof(frame);
+  char *start;
+  CHECK(!amp_write_descriptor(&pos, limit));
+  CHECK(!amp_write_ulong(&pos, limit, 0x77));
+  CHECK(!amp_write_start(&pos, limit, &start));
+  CHECK(!amp_write_list(&pos, limit, start, 0));
+  size_t size = pos - frame;
+  amp_write_frame_header(frame, size, 0, 0);
+
+  CHECK(amp_input(transport, frame, size) == size);
+  CHECK(!strcmp(transport->endpoint.local_error.condition, "amqp:decode-error"));
+  CHECK(amp_input(transport, frame, size) == EOS);
+
+  amp_destroy((amp_endpoint_t *) conn);
+}
+
+int main(int argc, char **argv)
+{
+  test_links();
+  test_output_ring();
+  test_decode_truncated();
+  test_decode_malformed();
+  test_decode_unknown();
+  printf("ok\n");
   return 0;
 }
@@ -20,7 +20,6 @@
  */
 
 #include <amp/codec.h>
-#include <iconv.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <wchar.h>
@@ -191,18 +190,7 @@ void amp_decode_binary(void *ctx, size_t size, char *bytes) {
 void amp_decode_utf8(void *ctx, size_t size, char *bytes) {
   amp_value_t *value = next_value(ctx);
   value->type = STRING;
-  size_t remaining = (size+1)*sizeof(wchar_t);
-  wchar_t buf[size+1];
-  iconv_t cd = iconv_open("WCHAR_T", "UTF-8");
-  wchar_t *out = buf;
-  size_t n = iconv(cd, &bytes, &size, (char **)&out, &remaining);
-  if (n == -1)
-  {
-    perror("amp_decode_utf8");
-  }
-  *out = L'\0';
-  iconv_close(cd);
-  value->u.as_string = amp_string(buf);
+  value->u.as_string = amp_string_utf8(bytes, size);
 }
 void amp_decode_symbol(void *ctx, size_t size, char *bytes) {
   //  amp_value_t *value = next_value(ctx);
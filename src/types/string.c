@@ -20,6 +20,8 @@
  */
 
 #include <amp/codec.h>
+#include <iconv.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "value-internal.h"
@@ -33,6 +35,24 @@ amp_string_t *amp_string(wchar_t *wcs)
   return str;
 }
 
+// a utf8 string never has fewer bytes than characters
+amp_string_t *amp_string_utf8(char *utf8, size_t size)
+{
+  amp_string_t *str = malloc(sizeof(amp_string_t) + (size+1)*sizeof(wchar_t));
+  size_t remaining = size*sizeof(wchar_t);
+  wchar_t *out = str->wcs;
+  iconv_t cd = iconv_open("WCHAR_T", "UTF-8");
+  size_t n = iconv(cd, &utf8, &size, (char **)&out, &remaining);
+  if (n == -1)
+  {
+    perror("amp_string_utf8");
+  }
+  *out = L'\0';
+  iconv_close(cd);
+  str->size = out - str->wcs;
+  return str;
+}
+
 void amp_free_string(amp_string_t *str)
 {
   free(str);